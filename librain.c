@@ -10,14 +10,26 @@
 #include <jerasure/reed_sol.h>
 
 #include "librain.h"
+#include "rain_cauchy.h"
+#include "rain_kernels.h"
 #include "utils.h"
 
 static struct rain_env_s env_DEFAULT = { malloc, calloc, free };
 
+/* The packet sizes tried by the default layout, by order of preference */
+static const size_t packet_sizes[] = {
+	2048, 1024, 512, 256, 128, 64,
+	1792, 896, 448, 224, 112,
+	1536, 768, 384, 192, 96,
+	1280, 640, 320, 160, 80,
+	0
+};
+
 static void
 _encoding_from_packet_size(struct rain_encoding_s *enc, size_t p_size)
 {
 	enc->packet_size = p_size;
+	enc->tail_packet_size = 0;
 	enc->strip_size = enc->packet_size * enc->w;
 	const size_t ks = enc->k * enc->strip_size;
 	if (enc->data_size > 0)
@@ -27,10 +39,58 @@ _encoding_from_packet_size(struct rain_encoding_s *enc, size_t p_size)
 	enc->block_size = enc->padded_data_size / enc->k;
 }
 
+/* The first packet size of 'packet_sizes' leaving at most one block of
+ * padding, i.e. with n stripes of k*w*p bytes, such as
+ * data_size >= (n*k*w*p) - (n*w*p). Beyond k-1 stripes of the largest
+ * packets, this always holds. */
+static size_t
+_default_packet_size(const struct rain_encoding_s *enc)
+{
+	const size_t ds = enc->data_size, k = enc->k, w = enc->w;
+	if (!ds)
+		return 64;
+	if (ds > (k - 1) * k * w * packet_sizes[0])
+		return packet_sizes[0];
+
+	for (const size_t *p = packet_sizes; *p ;++p) {
+		const size_t stripe = k * w * *p;
+		const size_t n = (ds + stripe - 1) / stripe;
+		if (ds >= n * w * *p * (k - 1))
+			return *p;
+	}
+	// We will have more than one block of padding, but it will work
+	return 64;
+}
+
+/* Full stripes of the largest packets, then a last stripe whose packets
+ * are just large enough for the remaining data. The padding is less
+ * than k*w*LIBRAIN_TAIL_ALIGN bytes, thus less than a strip. */
+static void
+_encoding_with_tail(struct rain_encoding_s *enc)
+{
+	const size_t k = enc->k, w = enc->w;
+	enc->packet_size = packet_sizes[0];
+	enc->strip_size = enc->packet_size * w;
+
+	const size_t stripe = k * enc->strip_size;
+	const size_t full = enc->data_size / stripe;
+	const size_t remaining = enc->data_size - (full * stripe);
+	if (remaining > 0 || full == 0) {
+		size_t tail = _upper_multiple((remaining + (k * w) - 1) / (k * w),
+				LIBRAIN_TAIL_ALIGN);
+		enc->tail_packet_size = MACRO_COND(tail > 0, tail, LIBRAIN_TAIL_ALIGN);
+	} else {
+		enc->tail_packet_size = 0;
+	}
+
+	enc->block_size = (full * enc->strip_size) + (w * enc->tail_packet_size);
+	enc->padded_data_size = k * enc->block_size;
+}
+
 static int
 encoding_prepare (struct rain_encoding_s *enc,
 		const char *algo, unsigned int k, unsigned int m,
-		size_t length)
+		size_t length, int flags)
 {
 	assert(algo != NULL);
 	assert(k > 0);
@@ -49,6 +109,14 @@ encoding_prepare (struct rain_encoding_s *enc,
     else if (!strcmp("crs", algo)) {
 		enc->algo = JALG_crs;
     }
+    else if (!strcmp("crs_min", algo)) {
+		// Only the profiles searched offline
+		if (!rain_cauchy_min_matrix(k, m, 4)) {
+			errno = EINVAL;
+			return 0;
+		}
+		enc->algo = JALG_crs_min;
+    }
     else {
 		errno  = EINVAL;
         return 0;
@@ -68,26 +136,19 @@ encoding_prepare (struct rain_encoding_s *enc,
 
 	if (enc->algo == JALG_liberation) {
 		enc->w = 8;
-	} else if (enc->algo == JALG_crs) {
+	} else if (enc->algo == JALG_crs || enc->algo == JALG_crs_min) {
 		enc->w = 4;
 	}
 
-	if (enc->data_size > 0) {
-		// Retry with intermediate values (this loop can be optimized)
-		for (size_t start = 2048; start >= 1280; start -= 256) {
-			for (size_t p_size = start; p_size >= 64; p_size /= 2) {
-				_encoding_from_packet_size(enc, p_size);
-				// More than a block of padding ?
-				if ((enc->padded_data_size != enc->data_size)
-						&& (enc->data_size < (enc->padded_data_size - enc->block_size)))
-					continue;
-				return 1;
-			}
+	if (flags & LIBRAIN_TAIL_STRIPE) {
+		if (k * LIBRAIN_TAIL_ALIGN > packet_sizes[0]) {
+			errno = EINVAL;
+			return 0;
 		}
+		_encoding_with_tail(enc);
+	} else {
+		_encoding_from_packet_size(enc, _default_packet_size(enc));
 	}
-
-	// We will have more than one block of padding, but it will work
-	_encoding_from_packet_size(enc, 64);
 	return 1;
 }
 
@@ -98,7 +159,26 @@ rain_get_encoding (struct rain_encoding_s *encoding, size_t rawlength,
 		unsigned int k, unsigned int m, const char *algo)
 {
 	assert(encoding != NULL);
-	return encoding_prepare(encoding, algo, k, m, rawlength);
+	return encoding_prepare(encoding, algo, k, m, rawlength, 0);
+}
+
+int
+rain_get_encoding_ext (struct rain_encoding_s *encoding, size_t rawlength,
+		unsigned int k, unsigned int m, const char *algo, int flags)
+{
+	assert(encoding != NULL);
+	return encoding_prepare(encoding, algo, k, m, rawlength, flags);
+}
+
+const char*
+rain_algorithm_name (enum rain_algorithm_e algo)
+{
+	switch (algo) {
+		case JALG_liberation: return "liber8tion";
+		case JALG_crs: return "crs";
+		case JALG_crs_min: return "crs_min";
+		default: return NULL;
+	}
 }
 
 static int
@@ -114,33 +194,812 @@ is_recoverable(struct rain_encoding_s *enc, int *erasures)
 	return 1;
 }
 
-static int
-do_rehydrate(struct rain_encoding_s *enc, uint8_t **data,
-		uint8_t **coding, int *erasures)
+/* ------------------------------------------------------------------------- */
+
+struct rain_decode_plan_s
+{
+	unsigned int k, m, w;
+	enum rain_algorithm_e algo;
+	unsigned int nb_targets;
+	int *sources; /**< The k blocks read, then a final -1 */
+	int *targets; /**< The nb_targets blocks rebuilt, then a final -1 */
+	int *bitmatrix; /**< (nb_targets*w) rows of (k*w) bits, over the sources */
+	int **schedule;
+	rain_kernel_f kernel; /**< Generated equivalent of the schedule, if any */
+	int borrowed; /**< Imported, only the array of operations is owned */
+};
+
+static rain_kernel_f
+_kernel_lookup(struct rain_encoding_s *enc, const int *targets)
+{
+#ifndef HAVE_NOKERNELS
+	if (enc->k + enc->m > 64)
+		return NULL;
+	uint64_t mask = 0;
+	for (; *targets >= 0; ++targets)
+		mask |= ((uint64_t)1) << *targets;
+	for (const struct rain_kernel_s *kern = rain_kernels;
+			kern->algo != JALG_unset; ++kern) {
+		if (kern->algo == enc->algo && kern->k == enc->k && kern->m == enc->m
+				&& kern->w == enc->w && kern->targets == mask)
+			return kern->run;
+	}
+#else
+	(void) enc, (void) targets;
+#endif
+	return NULL;
+}
+
+/* Returns the (m*w) x (k*w) coding bitmatrix of the algorithm, to be freed */
+static int *
+_coding_bitmatrix(struct rain_encoding_s *enc)
 {
-	/* Creating coding matrix or bitmatrix */
-	int *bit_matrix=NULL, *matrix=NULL;
 	if (enc->algo == JALG_liberation)
-		bit_matrix = liber8tion_coding_bitmatrix(enc->k);
-	else if (enc->algo == JALG_crs) {
-		matrix = cauchy_good_general_coding_matrix(enc->k, enc->m, enc->w);
-		bit_matrix = jerasure_matrix_to_bitmatrix(enc->k, enc->m, enc->w, matrix);
+		return liber8tion_coding_bitmatrix(enc->k);
+	if (enc->algo == JALG_crs) {
+		int *matrix = cauchy_good_general_coding_matrix(enc->k, enc->m, enc->w);
+		if (!matrix)
+			return NULL;
+		int *bit_matrix = jerasure_matrix_to_bitmatrix(enc->k, enc->m, enc->w, matrix);
+		free(matrix);
+		return bit_matrix;
+	}
+	if (enc->algo == JALG_crs_min) {
+		const int *matrix = rain_cauchy_min_matrix(enc->k, enc->m, enc->w);
+		if (!matrix)
+			return NULL;
+		return jerasure_matrix_to_bitmatrix(enc->k, enc->m, enc->w,
+				(int*) matrix);
 	}
+	return NULL;
+}
 
-	/* Choose proper decoding method */
-	jerasure_schedule_decode_lazy(enc->k, enc->m, enc->w,
-			bit_matrix, erasures, (char**)data, (char**)coding,
-			enc->block_size, enc->packet_size, 1);
+static int
+_in_list(const int *list, int idx)
+{
+	for (; *list >= 0; ++list) {
+		if (*list == idx)
+			return 1;
+	}
+	return 0;
+}
 
-	/* Freeing previously allocated memory */
-	if (bit_matrix)
-		free(bit_matrix);
-	if (matrix)
-		free(matrix);
+static int
+_kernel_fits(const struct rain_encoding_s *enc)
+{
+	return !(enc->packet_size % RAIN_KERNEL_VECTOR)
+		&& !(enc->tail_packet_size % RAIN_KERNEL_VECTOR);
+}
+
+static void
+_compute_region(const struct rain_encoding_s *enc, rain_kernel_f kernel,
+		int **schedule, unsigned int nb_dst, uint8_t **src, uint8_t **dst,
+		size_t size, size_t packet_size)
+{
+	if (kernel && !(packet_size % RAIN_KERNEL_VECTOR))
+		kernel(src, dst, size, packet_size);
+	else
+		jerasure_schedule_encode(enc->k, nb_dst, enc->w, schedule,
+				(char**) src, (char**) dst, size, packet_size);
+}
+
+/* Computes the 'dst' blocks from the k 'src' blocks, with the kernel if
+ * any, or else the schedule. The full stripes and the tail stripe have
+ * their own packet size. */
+static void
+_compute(const struct rain_encoding_s *enc, rain_kernel_f kernel,
+		int **schedule, unsigned int nb_dst, uint8_t **src, uint8_t **dst)
+{
+	const size_t tail = enc->w * enc->tail_packet_size;
+	const size_t head = enc->block_size - tail;
+
+	if (head > 0)
+		_compute_region(enc, kernel, schedule, nb_dst, src, dst,
+				head, enc->packet_size);
+	if (tail > 0) {
+		uint8_t *s[enc->k], *d[nb_dst];
+		for (unsigned int i = 0; i < enc->k; ++i)
+			s[i] = src[i] + head;
+		for (unsigned int i = 0; i < nb_dst; ++i)
+			d[i] = dst[i] + head;
+		_compute_region(enc, kernel, schedule, nb_dst, s, d,
+				tail, enc->tail_packet_size);
+	}
+}
+
+void
+rain_decode_plan_free(struct rain_decode_plan_s *plan)
+{
+	if (!plan)
+		return;
+	if (plan->borrowed) {
+		if (plan->schedule)
+			free(plan->schedule);
+		free(plan);
+		return;
+	}
+	if (plan->schedule)
+		jerasure_free_schedule(plan->schedule);
+	if (plan->bitmatrix)
+		free(plan->bitmatrix);
+	if (plan->sources)
+		free(plan->sources);
+	if (plan->targets)
+		free(plan->targets);
+	free(plan);
+}
+
+struct rain_decode_plan_s *
+rain_decode_plan_create_ext(struct rain_encoding_s *enc, int *targets,
+		int *sources)
+{
+	assert(enc != NULL);
+	assert(targets != NULL);
+
+	const unsigned int k = enc->k, w = enc->w, sum = enc->k + enc->m;
+	const unsigned int kw = k * w;
+
+	/* Check the targets, they must be distinct valid blocks */
+	unsigned int nb_targets = 0;
+	for (; targets[nb_targets] >= 0; ++nb_targets) {
+		if ((unsigned int)targets[nb_targets] >= sum
+				|| _in_list(targets + nb_targets + 1, targets[nb_targets])) {
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+
+	struct rain_decode_plan_s *plan = calloc(1, sizeof(*plan));
+	if (!plan) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	plan->k = enc->k;
+	plan->m = enc->m;
+	plan->w = enc->w;
+	plan->algo = enc->algo;
+	plan->nb_targets = nb_targets;
+	plan->sources = malloc((k + 1) * sizeof(int));
+	plan->targets = malloc((nb_targets + 1) * sizeof(int));
+	if (!plan->sources || !plan->targets) {
+		rain_decode_plan_free(plan);
+		errno = ENOMEM;
+		return NULL;
+	}
+	memcpy(plan->targets, targets, (nb_targets + 1) * sizeof(int));
+
+	/* Choose the sources: the caller's ones, or the first k intact blocks */
+	unsigned int nb_sources = 0;
+	int defaults = 1;
+	plan->sources[0] = -1;
+	if (sources) {
+		for (; nb_sources < k && sources[nb_sources] >= 0; ++nb_sources) {
+			int idx = sources[nb_sources];
+			if ((unsigned int)idx >= sum || _in_list(targets, idx)
+					|| _in_list(plan->sources, idx))
+				break;
+			plan->sources[nb_sources] = idx;
+			plan->sources[nb_sources + 1] = -1;
+		}
+	} else {
+		for (unsigned int i = 0; i < sum && nb_sources < k; ++i) {
+			if (!_in_list(targets, i))
+				plan->sources[nb_sources++] = i;
+		}
+	}
+	plan->sources[nb_sources] = -1;
+	if (nb_sources != k) {
+		rain_decode_plan_free(plan);
+		errno = EINVAL;
+		return NULL;
+	}
+	if (sources) {
+		unsigned int i = 0, expected = 0;
+		for (; i < k; ++i, ++expected) {
+			while (_in_list(targets, expected))
+				expected ++;
+			if ((unsigned int)plan->sources[i] != expected)
+				break;
+		}
+		defaults = (i == k);
+	}
+
+	int *coding = _coding_bitmatrix(enc);
+	int *survivors = calloc(kw * kw, sizeof(int));
+	int *decoding = malloc(kw * kw * sizeof(int));
+	plan->bitmatrix = calloc(nb_targets * w * kw, sizeof(int));
+	if (!coding || !survivors || !decoding || !plan->bitmatrix) {
+		errno = ENOMEM;
+		goto error;
+	}
+
+	/* The (k*w) x (k*w) bitmatrix giving the sources from the data blocks */
+	for (unsigned int i = 0; i < k; ++i) {
+		unsigned int idx = plan->sources[i];
+		int *row = survivors + (i * w * kw);
+		if (idx < k) {
+			for (unsigned int j = 0; j < w; ++j)
+				row[j * kw + idx * w + j] = 1;
+		} else {
+			memcpy(row, coding + ((idx - k) * w * kw), w * kw * sizeof(int));
+		}
+	}
+	/* ... inverted, it gives the data blocks from the sources */
+	if (jerasure_invert_bitmatrix(survivors, decoding, kw) < 0) {
+		errno = EDOM;
+		goto error;
+	}
+
+	/* A data target is a row of the decoding bitmatrix, a parity target is
+	 * its coding row applied to the decoding bitmatrix. */
+	for (unsigned int t = 0; t < nb_targets; ++t) {
+		unsigned int idx = targets[t];
+		int *out = plan->bitmatrix + (t * w * kw);
+		if (idx < k) {
+			memcpy(out, decoding + (idx * w * kw), w * kw * sizeof(int));
+			continue;
+		}
+		const int *in = coding + ((idx - k) * w * kw);
+		for (unsigned int r = 0; r < w; ++r) {
+			for (unsigned int x = 0; x < kw; ++x) {
+				if (!in[r * kw + x])
+					continue;
+				for (unsigned int c = 0; c < kw; ++c)
+					out[r * kw + c] ^= decoding[x * kw + c];
+			}
+		}
+	}
+
+	if (defaults)
+		plan->kernel = _kernel_lookup(enc, targets);
+	if (nb_targets > 0) {
+		plan->schedule = jerasure_smart_bitmatrix_to_schedule(k, nb_targets,
+				w, plan->bitmatrix);
+		if (!plan->schedule) {
+			errno = ENOMEM;
+			goto error;
+		}
+	}
 
+	free(coding);
+	free(survivors);
+	free(decoding);
+	return plan;
+
+error:
+	if (coding)
+		free(coding);
+	if (survivors)
+		free(survivors);
+	if (decoding)
+		free(decoding);
+	rain_decode_plan_free(plan);
+	return NULL;
+}
+
+struct rain_decode_plan_s *
+rain_decode_plan_create(struct rain_encoding_s *enc, int *erasures)
+{
+	assert(enc != NULL);
+	if (!is_recoverable(enc, erasures)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return rain_decode_plan_create_ext(enc, erasures, NULL);
+}
+
+const int *
+rain_decode_plan_sources(const struct rain_decode_plan_s *plan)
+{
+	assert(plan != NULL);
+	return plan->sources;
+}
+
+const int *
+rain_decode_plan_targets(const struct rain_decode_plan_s *plan)
+{
+	assert(plan != NULL);
+	return plan->targets;
+}
+
+const int *
+rain_decode_plan_bitmatrix(const struct rain_decode_plan_s *plan)
+{
+	assert(plan != NULL);
+	return plan->bitmatrix;
+}
+
+int
+rain_decode_plan_apply(const struct rain_decode_plan_s *plan,
+		struct rain_encoding_s *enc, uint8_t **data, uint8_t **parity)
+{
+	assert(plan != NULL);
+	assert(enc != NULL);
+	assert(data != NULL);
+	assert(parity != NULL);
+
+	if (plan->k != enc->k || plan->m != enc->m || plan->w != enc->w
+			|| plan->algo != enc->algo) {
+		errno = EINVAL;
+		return 0;
+	}
+	if (!plan->nb_targets)
+		return 1;
+
+	uint8_t *src[plan->k], *dst[plan->nb_targets];
+	for (unsigned int i = 0; i < plan->k; ++i) {
+		unsigned int idx = plan->sources[i];
+		src[i] = (idx < plan->k) ? data[idx] : parity[idx - plan->k];
+	}
+	for (unsigned int i = 0; i < plan->nb_targets; ++i) {
+		unsigned int idx = plan->targets[i];
+		dst[i] = (idx < plan->k) ? data[idx] : parity[idx - plan->k];
+	}
+
+	_compute(enc, plan->kernel, plan->schedule, plan->nb_targets, src, dst);
 	return 1;
 }
 
+unsigned int
+rain_decode_plan_operations(const struct rain_decode_plan_s *plan)
+{
+	assert(plan != NULL);
+	unsigned int count = 0;
+	if (plan->schedule) {
+		for (int **op = plan->schedule; (*op)[0] >= 0; ++op)
+			count ++;
+	}
+	return count;
+}
+
+/* The exported plan is a header of 6 ints (algo, k, m, w, nb_targets,
+ * nb_ops) then the sources, the targets, the bitmatrix and the schedule,
+ * an operation of 5 ints after the other with a final one full of -1. */
+#define PLAN_EXPORT_HEADER 6
+
+size_t
+rain_decode_plan_export(const struct rain_decode_plan_s *plan, int *out)
+{
+	assert(plan != NULL);
+
+	const unsigned int k = plan->k, w = plan->w, nt = plan->nb_targets;
+	const unsigned int nb_ops = rain_decode_plan_operations(plan);
+	const size_t count = PLAN_EXPORT_HEADER + (k + 1) + (nt + 1)
+		+ (nt * w * k * w) + 5 * (nb_ops + 1);
+	if (!out)
+		return count;
+
+	*(out++) = plan->algo;
+	*(out++) = k;
+	*(out++) = plan->m;
+	*(out++) = w;
+	*(out++) = nt;
+	*(out++) = nb_ops;
+	memcpy(out, plan->sources, (k + 1) * sizeof(int));
+	out += k + 1;
+	memcpy(out, plan->targets, (nt + 1) * sizeof(int));
+	out += nt + 1;
+	memcpy(out, plan->bitmatrix, nt * w * k * w * sizeof(int));
+	out += nt * w * k * w;
+	for (unsigned int i = 0; i < nb_ops; ++i, out += 5)
+		memcpy(out, plan->schedule[i], 5 * sizeof(int));
+	for (unsigned int i = 0; i < 5; ++i)
+		out[i] = -1;
+	return count;
+}
+
+struct rain_decode_plan_s *
+rain_decode_plan_import(struct rain_encoding_s *enc, const int *in,
+		size_t count)
+{
+	assert(enc != NULL);
+	assert(in != NULL);
+
+	const unsigned int k = enc->k, w = enc->w, sum = enc->k + enc->m;
+	if (count < PLAN_EXPORT_HEADER
+			|| in[0] != (int)enc->algo || in[1] != (int)k
+			|| in[2] != (int)enc->m || in[3] != (int)w
+			|| in[4] < 0 || (unsigned int)in[4] > enc->m || in[5] < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	const unsigned int nt = in[4], nb_ops = in[5];
+	const int *sources = in + PLAN_EXPORT_HEADER;
+	const int *targets = sources + k + 1;
+	const int *bitmatrix = targets + nt + 1;
+	const int *ops = bitmatrix + (nt * w * k * w);
+	if (count != (size_t)(ops - in) + 5 * ((size_t)nb_ops + 1)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Nothing read from 'in' may lead out of the blocks */
+	if (sources[k] != -1 || targets[nt] != -1) {
+		errno = EINVAL;
+		return NULL;
+	}
+	for (unsigned int i = 0; i < k; ++i) {
+		if (sources[i] < 0 || (unsigned int)sources[i] >= sum
+				|| _in_list(sources + i + 1, sources[i])
+				|| _in_list(targets, sources[i])) {
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+	for (unsigned int i = 0; i < nt; ++i) {
+		if (targets[i] < 0 || (unsigned int)targets[i] >= sum
+				|| _in_list(targets + i + 1, targets[i])) {
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+	for (unsigned int i = 0; i < nb_ops; ++i) {
+		const int *op = ops + 5 * i;
+		if (op[0] < 0 || (unsigned int)op[0] >= k + nt
+				|| op[1] < 0 || (unsigned int)op[1] >= w
+				|| (unsigned int)op[2] < k || (unsigned int)op[2] >= k + nt
+				|| op[3] < 0 || (unsigned int)op[3] >= w
+				|| (op[4] != 0 && op[4] != 1)) {
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+	if (ops[5 * nb_ops] != -1) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct rain_decode_plan_s *plan = calloc(1, sizeof(*plan));
+	if (!plan) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	plan->k = k;
+	plan->m = enc->m;
+	plan->w = w;
+	plan->algo = enc->algo;
+	plan->nb_targets = nt;
+	plan->borrowed = 1;
+	plan->sources = (int *) sources;
+	plan->targets = (int *) targets;
+	plan->bitmatrix = (int *) bitmatrix;
+	if (nt > 0) {
+		plan->schedule = malloc((nb_ops + 1) * sizeof(int *));
+		if (!plan->schedule) {
+			free(plan);
+			errno = ENOMEM;
+			return NULL;
+		}
+		for (unsigned int i = 0; i <= nb_ops; ++i)
+			plan->schedule[i] = (int *) (ops + 5 * i);
+	}
+
+	/* Same as a built plan, the kernel only serves the default sources */
+	unsigned int i = 0, expected = 0;
+	for (; i < k; ++i, ++expected) {
+		while (_in_list(targets, expected))
+			expected ++;
+		if ((unsigned int)sources[i] != expected)
+			break;
+	}
+	if (i == k)
+		plan->kernel = _kernel_lookup(enc, plan->targets);
+	return plan;
+}
+
+struct choice_s
+{
+	struct rain_encoding_s *enc;
+	double byte_cost;
+	unsigned int nb_candidates;
+	const int *candidates; /**< Available blocks, by increasing fetch cost */
+	const double *prefix; /**< prefix[i] = cost of the i first candidates */
+	int *chosen;
+
+	unsigned int nb_parity; /**< Parity blocks in the subsets explored */
+	double floor; /**< Lower bound of the decoding cost of these subsets */
+	double level_decode; /**< Cheapest decoding among them, or -1 */
+	int pruned; /**< Some of them were not evaluated */
+
+	double best_cost;
+	struct rain_decode_plan_s *best;
+};
+
+static int
+_cmp_int(const void *a, const void *b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+/* Builds the plan reading the chosen blocks, and keeps it if it is the
+ * cheapest so far */
+static void
+_choice_evaluate(struct choice_s *c, double fetch)
+{
+	const unsigned int k = c->enc->k;
+	int sources[k + 1], targets[k + 1];
+	memcpy(sources, c->chosen, k * sizeof(int));
+	qsort(sources, k, sizeof(int), _cmp_int);
+	sources[k] = -1;
+
+	unsigned int nb_targets = 0;
+	for (unsigned int i = 0; i < k; ++i) {
+		if (!_in_list(sources, i))
+			targets[nb_targets++] = i;
+	}
+	targets[nb_targets] = -1;
+
+	struct rain_decode_plan_s *plan = rain_decode_plan_create_ext(c->enc,
+			targets, sources);
+	if (!plan)
+		return;
+	// Each operation of the schedule runs once per packet of the block
+	const double decode = c->byte_cost * (double) rain_decode_plan_operations(plan)
+		* (double) (c->enc->block_size / c->enc->w);
+	const double cost = fetch + decode;
+	if (c->level_decode < 0.0 || decode < c->level_decode)
+		c->level_decode = decode;
+	if (!c->best || cost < c->best_cost) {
+		if (c->best)
+			rain_decode_plan_free(c->best);
+		c->best = plan;
+		c->best_cost = cost;
+	} else {
+		rain_decode_plan_free(plan);
+	}
+}
+
+/* Branch and bound over the subsets of k candidates holding exactly
+ * c->nb_parity parity blocks. A subset cannot be cheaper than its fetch
+ * cost plus the fetch cost of the cheapest candidates left, plus the
+ * floor of the decoding cost. */
+static void
+_choice_explore(struct choice_s *c, unsigned int pos, unsigned int depth,
+		unsigned int parity, double fetch)
+{
+	const unsigned int k = c->enc->k;
+	if (depth == k) {
+		_choice_evaluate(c, fetch);
+		return;
+	}
+	const unsigned int left = k - depth;
+	for (unsigned int i = pos; i + left <= c->nb_candidates; ++i) {
+		double bound = fetch + c->prefix[i + left] - c->prefix[i] + c->floor;
+		if (c->best && bound >= c->best_cost) {
+			c->pruned = 1;
+			break;
+		}
+		const int is_parity = ((unsigned int)c->candidates[i] >= k);
+		if (is_parity ? parity >= c->nb_parity
+				: depth - parity >= k - c->nb_parity)
+			continue;
+		c->chosen[depth] = c->candidates[i];
+		_choice_explore(c, i + 1, depth + 1, parity + is_parity,
+				fetch + c->prefix[i + 1] - c->prefix[i]);
+	}
+}
+
+struct rain_decode_plan_s *
+rain_decode_plan_choose(struct rain_encoding_s *enc, const int *available,
+		const double *costs, double byte_cost)
+{
+	assert(enc != NULL);
+	assert(available != NULL);
+
+	const unsigned int k = enc->k, sum = enc->k + enc->m;
+	int candidates[sum], chosen[k];
+	double prefix[sum + 1];
+	unsigned int nb = 0;
+	for (; available[nb] >= 0; ++nb) {
+		int dup = 0;
+		for (unsigned int i = 0; i < nb && !dup; ++i)
+			dup = (candidates[i] == available[nb]);
+		if (nb >= sum || (unsigned int)available[nb] >= sum || dup) {
+			errno = EINVAL;
+			return NULL;
+		}
+		candidates[nb] = available[nb];
+	}
+
+	// Insertion sort by fetch cost, the data blocks first on a tie
+	for (unsigned int i = 1; i < nb; ++i) {
+		int idx = candidates[i];
+		double cost = costs ? costs[idx] : 0.0;
+		unsigned int j = i;
+		for (; j > 0; --j) {
+			double prev = costs ? costs[candidates[j - 1]] : 0.0;
+			if (prev < cost || (!(prev > cost) && candidates[j - 1] < idx))
+				break;
+			candidates[j] = candidates[j - 1];
+		}
+		candidates[j] = idx;
+	}
+	prefix[0] = 0.0;
+	for (unsigned int i = 0; i < nb; ++i)
+		prefix[i + 1] = prefix[i] + (costs ? costs[candidates[i]] : 0.0);
+
+	unsigned int nb_data = 0;
+	for (unsigned int i = 0; i < nb; ++i)
+		nb_data += ((unsigned int)candidates[i] < k);
+
+	struct choice_s c;
+	memset(&c, 0, sizeof(c));
+	c.enc = enc;
+	c.byte_cost = byte_cost;
+	c.nb_candidates = nb;
+	c.candidates = candidates;
+	c.prefix = prefix;
+	c.chosen = chosen;
+
+	// The subsets are explored by increasing count of parity blocks read,
+	// i.e. of data blocks to rebuild. Rebuilding more blocks is assumed to
+	// cost at least the cheapest decoding with fewer, and the search stops
+	// once no subset can be cheaper than the best one: with equal fetch
+	// costs, only the subsets reading the fewest parity blocks are built.
+	const unsigned int first = MACRO_COND(nb_data < k, k - nb_data, 0);
+	for (unsigned int p = first; nb >= k && p <= k && p <= nb - nb_data; ++p) {
+		if (c.best && prefix[k] + c.floor >= c.best_cost)
+			break;
+		c.nb_parity = p;
+		c.level_decode = -1.0;
+		c.pruned = 0;
+		_choice_explore(&c, 0, 0, 0, 0.0);
+		// Only a level evaluated in full gives its cheapest decoding
+		if (!c.pruned && c.level_decode > c.floor)
+			c.floor = c.level_decode;
+	}
+
+	if (!c.best)
+		errno = EINVAL;
+	return c.best;
+}
+
+struct rain_progressive_s
+{
+	const struct rain_decode_plan_s *plan;
+	struct rain_encoding_s enc;
+	uint8_t **targets;
+	int *received; /**< One flag per source of the plan */
+	unsigned int nb_received;
+
+	/* The contribution of the i-th source is the list of packet XORs from
+	 * ops[first[i]] to ops[first[i+1]], each one as a pair of the packet
+	 * of the source and the packet row of the targets (t*w + x). */
+	unsigned int *first;
+	unsigned int *ops;
+};
+
+void
+rain_progressive_free(struct rain_progressive_s *p)
+{
+	if (!p)
+		return;
+	if (p->targets)
+		free(p->targets);
+	if (p->received)
+		free(p->received);
+	if (p->first)
+		free(p->first);
+	if (p->ops)
+		free(p->ops);
+	free(p);
+}
+
+struct rain_progressive_s *
+rain_progressive_create(const struct rain_decode_plan_s *plan,
+		struct rain_encoding_s *enc, uint8_t **targets)
+{
+	assert(plan != NULL);
+	assert(enc != NULL);
+	assert(targets != NULL || !plan->nb_targets);
+
+	if (plan->k != enc->k || plan->m != enc->m || plan->w != enc->w
+			|| plan->algo != enc->algo) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	const unsigned int k = plan->k, w = plan->w, kw = k * w;
+	const unsigned int rows = plan->nb_targets * w;
+	unsigned int ones = 0;
+	for (unsigned int i = 0; i < rows * kw; ++i)
+		ones += (plan->bitmatrix[i] != 0);
+
+	struct rain_progressive_s *p = calloc(1, sizeof(*p));
+	if (!p) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	p->plan = plan;
+	p->enc = *enc;
+	p->targets = malloc((plan->nb_targets + 1) * sizeof(uint8_t*));
+	p->received = calloc(k, sizeof(int));
+	p->first = malloc((k + 1) * sizeof(unsigned int));
+	p->ops = malloc((2 * ones + 1) * sizeof(unsigned int));
+	if (!p->targets || !p->received || !p->first || !p->ops) {
+		rain_progressive_free(p);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	unsigned int n = 0;
+	for (unsigned int i = 0; i < k; ++i) {
+		p->first[i] = n;
+		for (unsigned int y = 0; y < w; ++y) {
+			for (unsigned int r = 0; r < rows; ++r) {
+				if (!plan->bitmatrix[r * kw + i * w + y])
+					continue;
+				p->ops[2 * n] = y;
+				p->ops[2 * n + 1] = r;
+				n ++;
+			}
+		}
+	}
+	p->first[k] = n;
+
+	// The targets accumulate the contributions, from nothing
+	for (unsigned int t = 0; t < plan->nb_targets; ++t) {
+		p->targets[t] = targets[t];
+		memset(targets[t], 0, enc->block_size);
+	}
+	return p;
+}
+
+int
+rain_progressive_add(struct rain_progressive_s *p, unsigned int index,
+		const uint8_t *block)
+{
+	assert(p != NULL);
+	assert(block != NULL);
+
+	const unsigned int k = p->plan->k, w = p->plan->w;
+	unsigned int i = 0;
+	while (i < k && (unsigned int)p->plan->sources[i] != index)
+		i ++;
+	if (i >= k || p->received[i]) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	const size_t tail = w * p->enc.tail_packet_size;
+	const size_t head = p->enc.block_size - tail;
+	for (size_t offset = 0; offset < p->enc.block_size; ) {
+		const size_t ps = (offset < head) ? p->enc.packet_size
+			: p->enc.tail_packet_size;
+		for (unsigned int o = p->first[i]; o < p->first[i + 1]; ++o) {
+			const unsigned int y = p->ops[2 * o], r = p->ops[2 * o + 1];
+			const uint8_t *src = block + offset + (y * ps);
+			uint8_t *dst = p->targets[r / w] + offset + ((r % w) * ps);
+			galois_region_xor((char*) src, (char*) dst, ps);
+		}
+		offset += w * ps;
+	}
+
+	p->received[i] = 1;
+	p->nb_received ++;
+	return 1;
+}
+
+int
+rain_progressive_complete(const struct rain_progressive_s *p)
+{
+	assert(p != NULL);
+	return p->nb_received == p->plan->k;
+}
+
+static int
+do_rehydrate(struct rain_encoding_s *enc, uint8_t **data,
+		uint8_t **coding, int *erasures)
+{
+	struct rain_decode_plan_s *plan = rain_decode_plan_create_ext(enc,
+			erasures, NULL);
+	if (!plan)
+		return 0;
+	int rc = rain_decode_plan_apply(plan, enc, data, coding);
+	rain_decode_plan_free(plan);
+	return rc;
+}
+
 int
 rain_rehydrate_noalloc(struct rain_encoding_s *enc, uint8_t **data,
 		uint8_t **coding, int *erasures)
@@ -221,34 +1080,32 @@ rain_encode_noalloc (struct rain_encoding_s *encoding, uint8_t **data,
 {
 	assert(encoding != NULL);
 
-	// Prepare the jerasure structures
-	int *bit_matrix=NULL, *matrix=NULL, **schedule=NULL;
-	if (encoding->algo == JALG_liberation) {
-		matrix = NULL;
-		bit_matrix = liber8tion_coding_bitmatrix(encoding->k);
-		schedule = jerasure_smart_bitmatrix_to_schedule(encoding->k, encoding->m,
-				encoding->w, bit_matrix);
-	}
-	else if (encoding->algo == JALG_crs) {
-		matrix = cauchy_good_general_coding_matrix(
-				encoding->k, encoding->m, encoding->w);
-		bit_matrix = jerasure_matrix_to_bitmatrix(
-				encoding->k, encoding->m, encoding->w, matrix);
-		schedule = jerasure_smart_bitmatrix_to_schedule(
-				encoding->k, encoding->m, encoding->w, bit_matrix);
+	// A generated kernel does it without any schedule to interpret
+	if (_kernel_fits(encoding)) {
+		int targets[encoding->m + 1];
+		for (unsigned int i = 0; i < encoding->m; ++i)
+			targets[i] = encoding->k + i;
+		targets[encoding->m] = -1;
+		rain_kernel_f kernel = _kernel_lookup(encoding, targets);
+		if (kernel) {
+			_compute(encoding, kernel, NULL, encoding->m, data, parity);
+			return 1;
+		}
 	}
 
+	// Prepare the jerasure structures
+	int *bit_matrix = _coding_bitmatrix(encoding);
+	if (!bit_matrix)
+		return 0;
+	int **schedule = jerasure_smart_bitmatrix_to_schedule(encoding->k,
+			encoding->m, encoding->w, bit_matrix);
+
 	// Compute now ... damned, no return code to check
-	jerasure_schedule_encode(encoding->k, encoding->m, encoding->w, schedule,
-			(char**) data, (char**) parity,
-			encoding->block_size, encoding->packet_size);
+	_compute(encoding, NULL, schedule, encoding->m, data, parity);
 
 	if (schedule)
 		jerasure_free_schedule(schedule);
-	if (bit_matrix)
-		free(bit_matrix);
-	if (matrix)
-		free(matrix);
+	free(bit_matrix);
 
 	return 1;
 }
@@ -319,6 +1176,489 @@ rain_encode (uint8_t *rawdata, size_t rawlength,
 	return res;
 }
 
+/* ------------------------------------------------------------------------- */
+
+/* Runs the plan on one stripe. strips[i] is the strip of the i-th source
+ * (i < k) or target (i >= k) of the plan. */
+static void
+_plan_run_strips(const struct rain_decode_plan_s *plan, uint8_t **strips,
+		size_t packet_size)
+{
+	if (plan->kernel && !(packet_size % RAIN_KERNEL_VECTOR))
+		plan->kernel(strips, strips + plan->k, plan->w * packet_size, packet_size);
+	else
+		jerasure_do_scheduled_operations((char**) strips, plan->schedule,
+				packet_size);
+}
+
+/* Runs the plan on one stripe given packet by packet: packets[i*w + x]
+ * is the packet x of the i-th source (i < k) or target (i >= k). */
+static void
+_plan_run_packets(const struct rain_decode_plan_s *plan, uint8_t **packets,
+		size_t packet_size)
+{
+	for (int **op = plan->schedule; (*op)[0] >= 0; ++op) {
+		uint8_t *src = packets[(*op)[0] * plan->w + (*op)[1]];
+		uint8_t *dst = packets[(*op)[2] * plan->w + (*op)[3]];
+		if ((*op)[4])
+			galois_region_xor((char*) src, (char*) dst, packet_size);
+		else
+			memcpy(dst, src, packet_size);
+	}
+}
+
+struct iov_cursor_s
+{
+	const struct iovec *iov;
+	int iovcnt;
+	int seg; /**< The current segment */
+	size_t start; /**< Offset of the current segment in the object */
+};
+
+static void
+_iov_cursor_init(struct iov_cursor_s *c, const struct iovec *iov, int iovcnt)
+{
+	c->iov = iov;
+	c->iovcnt = iovcnt;
+	c->seg = 0;
+	c->start = 0;
+}
+
+/* Moves the cursor on the segment holding 'offset', forward only */
+static int
+_iov_seek(struct iov_cursor_s *c, size_t offset)
+{
+	while (c->seg < c->iovcnt && c->start + c->iov[c->seg].iov_len <= offset) {
+		c->start += c->iov[c->seg].iov_len;
+		c->seg ++;
+	}
+	return c->seg < c->iovcnt;
+}
+
+/* @return a pointer on the 'len' bytes at 'offset' if they are
+ * contiguous in one segment, NULL otherwise */
+static uint8_t *
+_iov_direct(struct iov_cursor_s *c, size_t offset, size_t len)
+{
+	if (!_iov_seek(c, offset))
+		return NULL;
+	if (offset + len > c->start + c->iov[c->seg].iov_len)
+		return NULL;
+	return ((uint8_t*) c->iov[c->seg].iov_base) + (offset - c->start);
+}
+
+/* Copies 'len' bytes at 'offset' into 'dst', the bytes beyond the end of
+ * the segments are zeroed */
+static void
+_iov_read(struct iov_cursor_s *c, size_t offset, uint8_t *dst, size_t len)
+{
+	while (len > 0 && _iov_seek(c, offset)) {
+		size_t avail = c->start + c->iov[c->seg].iov_len - offset;
+		size_t chunk = MACRO_COND(avail < len, avail, len);
+		memcpy(dst, ((uint8_t*) c->iov[c->seg].iov_base) + (offset - c->start),
+				chunk);
+		dst += chunk;
+		offset += chunk;
+		len -= chunk;
+	}
+	if (len > 0)
+		memset(dst, 0, len);
+}
+
+/* Copies 'len' bytes of 'src' at 'offset', the bytes beyond the end of the
+ * segments are ignored */
+static void
+_iov_write(struct iov_cursor_s *c, size_t offset, const uint8_t *src, size_t len)
+{
+	while (len > 0 && _iov_seek(c, offset)) {
+		size_t avail = c->start + c->iov[c->seg].iov_len - offset;
+		size_t chunk = MACRO_COND(avail < len, avail, len);
+		memcpy(((uint8_t*) c->iov[c->seg].iov_base) + (offset - c->start), src,
+				chunk);
+		src += chunk;
+		offset += chunk;
+		len -= chunk;
+	}
+}
+
+static size_t
+_iov_length(const struct iovec *iov, int iovcnt)
+{
+	size_t total = 0;
+	for (int i = 0; i < iovcnt; ++i)
+		total += iov[i].iov_len;
+	return total;
+}
+
+int
+rain_encode_iov (const struct iovec *iov, int iovcnt,
+		struct rain_encoding_s *enc, struct rain_env_s *env,
+		uint8_t **out)
+{
+	assert(iov != NULL || iovcnt == 0);
+	assert(enc != NULL);
+	assert(out != NULL);
+
+	if (!env)
+		env = &env_DEFAULT;
+
+	const unsigned int k = enc->k, m = enc->m, w = enc->w;
+	const size_t total = _iov_length(iov, iovcnt);
+	if (total > enc->data_size) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	// The encoding is the plan rebuilding all the parity blocks
+	int targets[m + 1];
+	for (unsigned int i = 0; i < m; ++i)
+		targets[i] = k + i;
+	targets[m] = -1;
+	struct rain_decode_plan_s *plan = rain_decode_plan_create_ext(enc,
+			targets, NULL);
+	if (!plan)
+		return 0;
+
+	const size_t max_ps = MACRO_COND(enc->tail_packet_size > enc->packet_size,
+			enc->tail_packet_size, enc->packet_size);
+	uint8_t *parity[m];
+	memset(parity, 0, sizeof(parity));
+	uint8_t *bounce = env->malloc(k * w * max_ps);
+	int rc = (bounce != NULL);
+	for (unsigned int i = 0; rc && i < m; ++i) {
+		parity[i] = env->malloc(enc->block_size);
+		rc = (parity[i] != NULL);
+	}
+	if (!rc) {
+		for (unsigned int i = 0; i < m; ++i) {
+			if (parity[i])
+				env->free(parity[i]);
+		}
+		if (bounce)
+			env->free(bounce);
+		rain_decode_plan_free(plan);
+		errno = ENOMEM;
+		return 0;
+	}
+
+	struct iov_cursor_s cursors[k];
+	for (unsigned int i = 0; i < k; ++i)
+		_iov_cursor_init(cursors + i, iov, iovcnt);
+
+	const size_t tail = w * enc->tail_packet_size;
+	const size_t head = enc->block_size - tail;
+	for (size_t offset = 0; offset < enc->block_size; ) {
+		const size_t ps = (offset < head) ? enc->packet_size : enc->tail_packet_size;
+		const size_t strip = w * ps;
+
+		// Whole strips when possible, this is the common case
+		uint8_t *strips[k + m];
+		int contiguous = 1;
+		for (unsigned int i = 0; i < k; ++i) {
+			size_t start = (i * enc->block_size) + offset;
+			strips[i] = (start + strip <= total)
+				? _iov_direct(cursors + i, start, strip) : NULL;
+			contiguous &= (strips[i] != NULL);
+		}
+		for (unsigned int i = 0; i < m; ++i)
+			strips[k + i] = parity[i] + offset;
+
+		if (contiguous) {
+			_plan_run_strips(plan, strips, ps);
+		} else {
+			// Only the packets across segments (or the padding) are copied
+			uint8_t *packets[(k + m) * w];
+			for (unsigned int i = 0; i < k; ++i) {
+				for (unsigned int x = 0; x < w; ++x) {
+					size_t start = (i * enc->block_size) + offset + (x * ps);
+					uint8_t *p = (start + ps <= total)
+						? _iov_direct(cursors + i, start, ps) : NULL;
+					if (!p) {
+						p = bounce + ((i * w + x) * ps);
+						_iov_read(cursors + i, start, p, ps);
+					}
+					packets[i * w + x] = p;
+				}
+			}
+			for (unsigned int i = 0; i < m; ++i) {
+				for (unsigned int x = 0; x < w; ++x)
+					packets[(k + i) * w + x] = strips[k + i] + (x * ps);
+			}
+			_plan_run_packets(plan, packets, ps);
+		}
+		offset += strip;
+	}
+
+	env->free(bounce);
+	rain_decode_plan_free(plan);
+	for (unsigned int i = 0; i < m; ++i)
+		out[i] = parity[i];
+	return 1;
+}
+
+int
+rain_rehydrate_iov (uint8_t **data, uint8_t **parity,
+		struct rain_encoding_s *enc, struct rain_env_s *env,
+		const struct iovec *iov, int iovcnt)
+{
+	assert(data != NULL);
+	assert(parity != NULL);
+	assert(enc != NULL);
+	assert(iov != NULL || iovcnt == 0);
+
+	if (!env)
+		env = &env_DEFAULT;
+
+	const unsigned int k = enc->k, m = enc->m, w = enc->w;
+	if (_iov_length(iov, iovcnt) < enc->data_size) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	// Only the missing data blocks are rebuilt, from the first k intact
+	int targets[k + 1], sources[k + 1];
+	unsigned int nb_targets = 0, nb_sources = 0;
+	for (unsigned int i = 0; i < k; ++i) {
+		if (!data[i])
+			targets[nb_targets++] = i;
+	}
+	targets[nb_targets] = -1;
+	for (unsigned int i = 0; i < k + m && nb_sources < k; ++i) {
+		if ((i < k) ? data[i] != NULL : parity[i - k] != NULL)
+			sources[nb_sources++] = i;
+	}
+	sources[nb_sources] = -1;
+	if (nb_sources < k) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	struct iov_cursor_s cursor;
+	_iov_cursor_init(&cursor, iov, iovcnt);
+
+	if (!nb_targets) {
+		for (unsigned int i = 0; i < k; ++i) {
+			size_t start = i * enc->block_size;
+			if (start >= enc->data_size)
+				break;
+			size_t len = MACRO_COND(enc->data_size - start < enc->block_size,
+					enc->data_size - start, enc->block_size);
+			_iov_write(&cursor, start, data[i], len);
+		}
+		return 1;
+	}
+
+	struct rain_decode_plan_s *plan = rain_decode_plan_create_ext(enc,
+			targets, sources);
+	if (!plan)
+		return 0;
+
+	const size_t max_ps = MACRO_COND(enc->tail_packet_size > enc->packet_size,
+			enc->tail_packet_size, enc->packet_size);
+	uint8_t *rebuilt = env->malloc(nb_targets * w * max_ps);
+	if (!rebuilt) {
+		rain_decode_plan_free(plan);
+		errno = ENOMEM;
+		return 0;
+	}
+
+	// Stripe by stripe, the missing strips are rebuilt in a small buffer
+	// then all the strips are copied in the object order.
+	const size_t tail = w * enc->tail_packet_size;
+	const size_t head = enc->block_size - tail;
+	struct iov_cursor_s cursors[k];
+	for (unsigned int i = 0; i < k; ++i)
+		_iov_cursor_init(cursors + i, iov, iovcnt);
+
+	for (size_t offset = 0; offset < enc->block_size; ) {
+		const size_t ps = (offset < head) ? enc->packet_size : enc->tail_packet_size;
+		const size_t strip = w * ps;
+
+		uint8_t *strips[k + nb_targets];
+		for (unsigned int i = 0; i < k; ++i) {
+			unsigned int idx = sources[i];
+			strips[i] = ((idx < k) ? data[idx] : parity[idx - k]) + offset;
+		}
+		for (unsigned int i = 0; i < nb_targets; ++i)
+			strips[k + i] = rebuilt + (i * strip);
+		_plan_run_strips(plan, strips, ps);
+
+		for (unsigned int i = 0, t = 0; i < k; ++i) {
+			size_t start = (i * enc->block_size) + offset;
+			const uint8_t *src = data[i] ? data[i] + offset : strips[k + t++];
+			if (start >= enc->data_size)
+				continue;
+			size_t len = MACRO_COND(enc->data_size - start < strip,
+					enc->data_size - start, strip);
+			_iov_write(cursors + i, start, src, len);
+		}
+		offset += strip;
+	}
+
+	env->free(rebuilt);
+	rain_decode_plan_free(plan);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+typedef uint64_t zero_v __attribute__ ((vector_size (16)));
+
+/* Tells if the packet is all zero, 64 bytes at a time so that non-zero
+ * data is detected at once */
+static int
+_is_zero(const uint8_t *p, size_t len)
+{
+	size_t i = 0;
+	for (; i + 64 <= len; i += 64) {
+		zero_v v[4];
+		memcpy(v, p + i, sizeof(v));
+		zero_v acc = v[0] | v[1] | v[2] | v[3];
+		if (acc[0] | acc[1])
+			return 0;
+	}
+	for (; i < len; ++i) {
+		if (p[i])
+			return 0;
+	}
+	return 1;
+}
+
+/* Same as _plan_run_packets(), the zero sources being skipped: XORing
+ * them does nothing, copying them is zeroing the destination. */
+static void
+_plan_run_sparse(const struct rain_decode_plan_s *plan, uint8_t **packets,
+		const int *zero, size_t packet_size)
+{
+	const int kw = plan->k * plan->w;
+	for (int **op = plan->schedule; (*op)[0] >= 0; ++op) {
+		const int s = (*op)[0] * plan->w + (*op)[1];
+		uint8_t *dst = packets[(*op)[2] * plan->w + (*op)[3]];
+		if (s < kw && zero[s]) {
+			if (!(*op)[4])
+				memset(dst, 0, packet_size);
+		} else if ((*op)[4]) {
+			galois_region_xor((char*) packets[s], (char*) dst, packet_size);
+		} else {
+			memcpy(dst, packets[s], packet_size);
+		}
+	}
+}
+
+int
+rain_encode_sparse (struct rain_encoding_s *enc, uint8_t **data,
+		uint8_t **parity, struct rain_sparse_stats_s *stats)
+{
+	assert(enc != NULL);
+	assert(data != NULL);
+	assert(parity != NULL);
+
+	const unsigned int k = enc->k, m = enc->m, w = enc->w;
+	int targets[m + 1];
+	for (unsigned int i = 0; i < m; ++i)
+		targets[i] = k + i;
+	targets[m] = -1;
+	struct rain_decode_plan_s *plan = rain_decode_plan_create_ext(enc,
+			targets, NULL);
+	if (!plan)
+		return 0;
+
+	const size_t tail = w * enc->tail_packet_size;
+	const size_t head = enc->block_size - tail;
+	for (size_t offset = 0; offset < enc->block_size; ) {
+		const size_t ps = (offset < head) ? enc->packet_size : enc->tail_packet_size;
+		const size_t strip = w * ps;
+
+		uint8_t *packets[(k + m) * w];
+		int zero[k * w];
+		unsigned int nb_zero = 0;
+		for (unsigned int i = 0; i < k + m; ++i) {
+			uint8_t *base = ((i < k) ? data[i] : parity[i - k]) + offset;
+			for (unsigned int x = 0; x < w; ++x)
+				packets[i * w + x] = base + (x * ps);
+		}
+		for (unsigned int p = 0; p < k * w; ++p) {
+			zero[p] = _is_zero(packets[p], ps);
+			nb_zero += zero[p];
+		}
+
+		if (nb_zero == k * w) {
+			for (unsigned int i = 0; i < m; ++i)
+				memset(parity[i] + offset, 0, strip);
+		} else if (!nb_zero) {
+			uint8_t *strips[k + m];
+			for (unsigned int i = 0; i < k + m; ++i)
+				strips[i] = packets[i * w];
+			_plan_run_strips(plan, strips, ps);
+		} else {
+			_plan_run_sparse(plan, packets, zero, ps);
+		}
+
+		if (stats) {
+			stats->bytes_scanned += k * strip;
+			stats->bytes_skipped += nb_zero * ps;
+			stats->stripes_skipped += (nb_zero == k * w);
+		}
+		offset += strip;
+	}
+
+	rain_decode_plan_free(plan);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int
+rain_encode_fused (const uint8_t *rawdata, size_t rawlength,
+		struct rain_encoding_s *enc, uint8_t **fragments, size_t header_size)
+{
+	assert(rawdata != NULL || rawlength == 0);
+	assert(enc != NULL);
+	assert(fragments != NULL);
+
+	const unsigned int k = enc->k, m = enc->m, w = enc->w;
+	if (rawlength > enc->data_size) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	int targets[m + 1];
+	for (unsigned int i = 0; i < m; ++i)
+		targets[i] = k + i;
+	targets[m] = -1;
+	struct rain_decode_plan_s *plan = rain_decode_plan_create_ext(enc,
+			targets, NULL);
+	if (!plan)
+		return 0;
+
+	// Stripe by stripe, the data strips are copied then encoded while
+	// they are still in the cache.
+	const size_t tail = w * enc->tail_packet_size;
+	const size_t head = enc->block_size - tail;
+	for (size_t offset = 0; offset < enc->block_size; ) {
+		const size_t ps = (offset < head) ? enc->packet_size : enc->tail_packet_size;
+		const size_t strip = w * ps;
+
+		uint8_t *strips[k + m];
+		for (unsigned int i = 0; i < k + m; ++i)
+			strips[i] = fragments[i] + header_size + offset;
+		for (unsigned int i = 0; i < k; ++i) {
+			size_t start = (i * enc->block_size) + offset, len = 0;
+			if (start < rawlength)
+				len = MACRO_COND(rawlength - start < strip, rawlength - start, strip);
+			if (len)
+				memcpy(strips[i], rawdata + start, len);
+			if (len < strip)
+				memset(strips[i] + len, 0, strip - len);
+		}
+		_plan_run_strips(plan, strips, ps);
+		offset += strip;
+	}
+
+	rain_decode_plan_free(plan);
+	return 1;
+}
+
 #ifndef HAVE_NOLEGACY
 /* ------------------------------------------------------------------------- */
 
@@ -330,7 +1670,7 @@ rain_get_coding_chunks(uint8_t *data, size_t length,
 		return NULL;
 
 	struct rain_encoding_s encoding;
-	if (!encoding_prepare(&encoding, algo, k, m, length))
+	if (!encoding_prepare(&encoding, algo, k, m, length, 0))
 		return NULL;
 
 	uint8_t *out[m];
@@ -348,7 +1688,7 @@ rain_repair_and_get_raw_data(uint8_t **data, uint8_t **coding,
 		const char* algo)
 {
 	struct rain_encoding_s enc;
-	if (!encoding_prepare(&enc, algo, k, m, rawlength))
+	if (!encoding_prepare(&enc, algo, k, m, rawlength, 0))
 		return EXIT_FAILURE;
 	int rc = rain_rehydrate(data, coding, &enc, &env_DEFAULT);
 	return MACRO_COND(rc!=0,EXIT_SUCCESS,EXIT_FAILURE);
@@ -368,7 +1708,7 @@ get_chunk_size(int length, int k, int m, const char* algo)
 	struct rain_encoding_s enc;
 	if (length < 0 || k < 0 || m < 0)
 		return -1;
-	if (!encoding_prepare(&enc, algo, k, m, length))
+	if (!encoding_prepare(&enc, algo, k, m, length, 0))
 		return -1;
 	return enc.block_size;
 }
@@ -2,9 +2,18 @@
 #define LIBRAIN_H 1
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 #define LIBRAIN_NOALLOC 0x01
 
+/** Layout option: the last stripe gets smaller packets, so that the
+ * padding stays below one strip whatever the size of the data */
+#define LIBRAIN_TAIL_STRIPE 0x02
+
+/** The packets of the tail stripe are a multiple of this size, the
+ * padding is thus less than k * w * LIBRAIN_TAIL_ALIGN bytes */
+#define LIBRAIN_TAIL_ALIGN 16
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -12,7 +21,8 @@ extern "C" {
 enum rain_algorithm_e {
 	JALG_unset = 0,
 	JALG_liberation,
-	JALG_crs
+	JALG_crs,
+	JALG_crs_min /**< Cauchy RS with the lightest known bitmatrix */
 };
 
 struct rain_env_s
@@ -33,6 +43,10 @@ struct rain_encoding_s
 	size_t data_size;
 	size_t padded_data_size; /**< The size of original data + padding */
 	size_t strip_size;
+
+	/** The packet size of the last stripe of each block, or 0 when all
+	 * the stripes use packet_size (cf. LIBRAIN_TAIL_STRIPE). */
+	size_t tail_packet_size;
 };
 
 /**
@@ -42,12 +56,24 @@ struct rain_encoding_s
  * @param rawlength the length of data that will be encoded or rehydrated
  * @param k the number of data blocks
  * @param m the number of parity blocks
- * @param algo the name of a RAIN algorithm ("liber8tion" or "crs")
+ * @param algo the name of a RAIN algorithm ("liber8tion", "crs" or "crs_min")
  * @return 0 on error (errno is set)
  */
 int rain_get_encoding (struct rain_encoding_s *encoding, size_t rawlength,
 		unsigned int k, unsigned int m, const char *algo);
 
+/** Same as rain_get_encoding(), with layout options.
+ *
+ * @param flags 0 for the default layout, or LIBRAIN_TAIL_STRIPE
+ * @return 0 on error (errno is set)
+ */
+int rain_get_encoding_ext (struct rain_encoding_s *encoding, size_t rawlength,
+		unsigned int k, unsigned int m, const char *algo, int flags);
+
+/** @return the name of the algorithm, as accepted by rain_get_encoding(),
+ *   or NULL if it is unknown */
+const char* rain_algorithm_name (enum rain_algorithm_e algo);
+
 /** Fills 'out' with an array of coding chunks resulting from the parity
  * computation of the original file previously stripped and overheaded with
  * '0' at its end.
@@ -78,6 +104,40 @@ int rain_encode (uint8_t *rawdata, size_t rawlength,
 int rain_encode_noalloc (struct rain_encoding_s *enc, uint8_t **data,
 		uint8_t **out);
 
+/** Counters of rain_encode_sparse(), accumulated over the calls */
+struct rain_sparse_stats_s
+{
+	uint64_t bytes_scanned; /**< Bytes of data blocks tested */
+	uint64_t bytes_skipped; /**< Bytes of zero packets, never XORed */
+	uint64_t stripes_skipped; /**< Stripes of zeroes, with zero parity */
+};
+
+/** Same as rain_encode_noalloc(), for data with large extents of zeroes
+ * (e.g. disk images). The zero packets are detected and their part of the
+ * computation is skipped, the parity of a stripe of zeroes is just zeroed.
+ *
+ * @param stats can be NULL, else its counters are incremented
+ * @return a boolean value, false if it failed
+ */
+int rain_encode_sparse (struct rain_encoding_s *enc, uint8_t **data,
+		uint8_t **parity, struct rain_sparse_stats_s *stats);
+
+/** Encodes the object and writes all its blocks, data and parity, into
+ * the caller's fragments, in a single pass over the object: each strip
+ * is encoded right after being copied.
+ *
+ * @param rawdata the object, rawlength bytes, no padding expected
+ * @param rawlength at most enc->data_size
+ * @param enc cannot be NULL
+ * @param fragments must have enc->k+enc->m slots of header_size +
+ *   enc->block_size bytes, the data blocks first
+ * @param header_size the bytes left untouched at the front of each
+ *   fragment, for a header (e.g. rain_fragment_header_size())
+ * @return a boolean value, false if it failed (errno is set)
+ */
+int rain_encode_fused (const uint8_t *rawdata, size_t rawlength,
+		struct rain_encoding_s *enc, uint8_t **fragments, size_t header_size);
+
 /** Regenerates missing data or coding chunks and returns the original data
  * (with a possible overhead of numerous '0' at its end).
  * @param data is expected to have at least enc->k slots,
@@ -107,6 +167,171 @@ int rain_rehydrate (uint8_t **data, uint8_t **coding,
 int rain_rehydrate_noalloc (struct rain_encoding_s *enc, uint8_t **data,
 		uint8_t **parity, int *erasures);
 
+/** Same as rain_encode(), the object being given as a list of segments
+ * (e.g. as received from the network). The segments are read in place,
+ * only the packets spanning two segments, and the padding, are copied.
+ *
+ * @param iov the segments of the object, possibly empty ones
+ * @param iovcnt the number of segments
+ * @param enc cannot be NULL, its data_size must be at least the total
+ *   length of the segments.
+ * @param env can be NULL
+ * @param out must have at least enc->m slots
+ * @return a boolean value, false if it failed (errno is set)
+ */
+int rain_encode_iov (const struct iovec *iov, int iovcnt,
+		struct rain_encoding_s *enc, struct rain_env_s *env,
+		uint8_t **out);
+
+/** Regenerates the missing data blocks and writes the original object,
+ * without its padding, into a list of segments. The blocks provided are
+ * left untouched, the rebuilt ones are never allocated in full.
+ *
+ * @param data must have at least enc->k slots, NULL for the missing blocks
+ * @param parity must have at least enc->m slots, NULL for the missing blocks
+ * @param enc cannot be NULL
+ * @param env can be NULL
+ * @param iov the segments to fill, at least enc->data_size bytes long
+ * @param iovcnt the number of segments
+ * @return a boolean value, false if it failed (errno is set)
+ */
+int rain_rehydrate_iov (uint8_t **data, uint8_t **parity,
+		struct rain_encoding_s *enc, struct rain_env_s *env,
+		const struct iovec *iov, int iovcnt);
+
+/* Decoding plans */
+
+/** The precomputed schedule rebuilding a set of blocks from k others.
+ * It only depends on the algorithm, k, m and the erasure pattern, so
+ * the same plan can be applied to any number of objects sharing them
+ * (whatever their size). A plan is read-only once built, it can be
+ * applied concurrently. */
+struct rain_decode_plan_s;
+
+/** Builds the plan rebuilding all the erased blocks from the first k
+ * intact blocks.
+ *
+ * @param enc a non-NULL (struct rain_encoding_s *) pointer.
+ * @param erasures indices of the missing blocks, and a final -1
+ * @return NULL on error (errno is set)
+ */
+struct rain_decode_plan_s* rain_decode_plan_create (
+		struct rain_encoding_s *enc, int *erasures);
+
+/** Builds the plan rebuilding the 'targets' blocks from exactly the
+ * 'sources' blocks.
+ *
+ * @param enc a non-NULL (struct rain_encoding_s *) pointer.
+ * @param targets indices of the blocks to rebuild, and a final -1
+ * @param sources indices of k blocks to read, and a final -1. If NULL,
+ *   the first k blocks not in 'targets' are used.
+ * @return NULL on error (errno is set)
+ */
+struct rain_decode_plan_s* rain_decode_plan_create_ext (
+		struct rain_encoding_s *enc, int *targets, int *sources);
+
+/** @return the indices of the k blocks read by the plan, and a final -1 */
+const int* rain_decode_plan_sources (const struct rain_decode_plan_s *plan);
+
+/** @return the indices of the blocks rebuilt by the plan, and a final -1 */
+const int* rain_decode_plan_targets (const struct rain_decode_plan_s *plan);
+
+/** @return the bitmatrix of the plan: w rows per target, each of k*w bits
+ *   (one int per bit) telling which packets of the sources are XORed. */
+const int* rain_decode_plan_bitmatrix (const struct rain_decode_plan_s *plan);
+
+/** Rebuilds the targets of the plan. This function does not allocate
+ * memory, the target blocks must be provided.
+ *
+ * @param enc must have the algo, k, m and w the plan was built with.
+ * @param data must have at least enc->k slots, the sources and targets
+ *   among them must be set to blocks of enc->block_size bytes.
+ * @param parity must have at least enc->m slots, same as 'data'.
+ * @return a boolean value, false if it failed
+ */
+int rain_decode_plan_apply (const struct rain_decode_plan_s *plan,
+		struct rain_encoding_s *enc, uint8_t **data, uint8_t **parity);
+
+void rain_decode_plan_free (struct rain_decode_plan_s *plan);
+
+/** @return the number of packet operations (XOR or copy) run by the plan
+ *   on each stripe, i.e. its decoding cost. */
+unsigned int rain_decode_plan_operations (
+		const struct rain_decode_plan_s *plan);
+
+/** Serializes the plan as a sequence of ints, that
+ * rain_decode_plan_import() turns back into a plan without any inversion
+ * nor scheduling. The ints are in the byte order of the host.
+ *
+ * @param out NULL to only get the count, else at least that many ints
+ * @return the number of ints of the serialized plan
+ */
+size_t rain_decode_plan_export (const struct rain_decode_plan_s *plan,
+		int *out);
+
+/** Rebuilds a plan from the output of rain_decode_plan_export(). The plan
+ * refers to 'in' without copying it, 'in' must outlive it.
+ *
+ * @param enc must have the algo, k, m and w the plan was built with.
+ * @param count the number of ints in 'in'
+ * @return NULL on error (errno is set, EINVAL if 'in' is not a valid plan
+ *   for 'enc')
+ */
+struct rain_decode_plan_s* rain_decode_plan_import (
+		struct rain_encoding_s *enc, const int *in, size_t count);
+
+/** Chooses the k blocks to read among the available ones, minimizing the
+ * cost of fetching them plus the cost of decoding, and builds the plan
+ * rebuilding the data blocks not read. Rebuilding more data blocks is
+ * assumed to cost at least as much to decode, so that the candidates
+ * reading more parity blocks are only built when they fetch for less.
+ *
+ * @param enc a non-NULL (struct rain_encoding_s *) pointer.
+ * @param available indices of the blocks that can be fetched, and a final -1
+ * @param costs the non-negative cost of fetching each block (indexed from 0
+ *   to enc->k+enc->m-1), e.g. a latency. NULL if they all cost the same.
+ * @param byte_cost the cost of processing one byte, in the unit of 'costs'
+ * @return NULL on error (errno is set), else the plan whose sources are
+ *   the blocks to fetch, cf. rain_decode_plan_sources()
+ */
+struct rain_decode_plan_s* rain_decode_plan_choose (
+		struct rain_encoding_s *enc, const int *available,
+		const double *costs, double byte_cost);
+
+/* Progressive decoding */
+
+/** Rebuilds the targets of a plan as its sources arrive, one by one and
+ * in any order: each source is added to the targets as soon as it is
+ * received, so that only the contribution of the last one remains to be
+ * computed when it lands. The calls on the same decoder must not be
+ * concurrent. */
+struct rain_progressive_s;
+
+/** @param plan must outlive the decoder
+ * @param enc must have the algo, k, m and w the plan was built with.
+ * @param targets one block of enc->block_size bytes per target of the
+ *   plan, in the order of rain_decode_plan_targets(). They are zeroed.
+ * @return NULL on error (errno is set)
+ */
+struct rain_progressive_s* rain_progressive_create (
+		const struct rain_decode_plan_s *plan, struct rain_encoding_s *enc,
+		uint8_t **targets);
+
+/** Adds the contribution of a source, the block is not kept.
+ *
+ * @param index the index of a source of the plan, not yet added
+ * @param block the content of the source, enc->block_size bytes
+ * @return a boolean value, false if it failed (errno is set)
+ */
+int rain_progressive_add (struct rain_progressive_s *decoder,
+		unsigned int index, const uint8_t *block);
+
+/** @return true once all the sources are added, the targets are then
+ *   rebuilt */
+int rain_progressive_complete (const struct rain_progressive_s *decoder);
+
+void rain_progressive_free (struct rain_progressive_s *decoder);
+
 #ifndef HAVE_NOLEGACY
 /* Legacy interface */
 
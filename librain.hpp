@@ -0,0 +1,467 @@
+#ifndef LIBRAIN_HPP
+#define LIBRAIN_HPP 1
+
+/* C++17 interface over librain.h, header-only.
+ *
+ * rain::codec<Algo, K, M> fixes the profile at compile time: the layout
+ * is computed by constexpr functions, the blocks are held in std::array.
+ * rain::dynamic_codec offers the same operations for a profile only
+ * known at run time. Errors are thrown as std::system_error, with the
+ * errno set by librain. */
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <system_error>
+#include <type_traits>
+#if __has_include(<span>)
+# include <span>
+#endif
+
+#include "librain.h"
+
+namespace rain {
+
+#if defined(__cpp_lib_span) && __cpp_lib_span >= 202002L
+template <class T> using span = std::span<T>;
+#else
+/** The subset of std::span (C++20) used here: a pointer and a size */
+template <class T>
+class span
+{
+public:
+	using element_type = T;
+	constexpr span() noexcept : ptr_(nullptr), size_(0) {}
+	constexpr span(T *ptr, std::size_t size) noexcept : ptr_(ptr), size_(size) {}
+	template <class C, class = decltype(std::declval<C&>().data())>
+	constexpr span(C &c) noexcept : ptr_(c.data()), size_(c.size()) {}
+	template <class U, class = std::enable_if_t<std::is_convertible<U(*)[], T(*)[]>::value>>
+	constexpr span(const span<U> &o) noexcept : ptr_(o.data()), size_(o.size()) {}
+
+	constexpr T *data() const noexcept { return ptr_; }
+	constexpr std::size_t size() const noexcept { return size_; }
+	constexpr bool empty() const noexcept { return size_ == 0; }
+	constexpr T &operator[](std::size_t i) const noexcept { return ptr_[i]; }
+	constexpr T *begin() const noexcept { return ptr_; }
+	constexpr T *end() const noexcept { return ptr_ + size_; }
+	constexpr span subspan(std::size_t off, std::size_t len) const noexcept {
+		return span(ptr_ + off, len);
+	}
+private:
+	T *ptr_;
+	std::size_t size_;
+};
+#endif
+
+enum class algo {
+	liberation = JALG_liberation,
+	crs = JALG_crs,
+	crs_min = JALG_crs_min,
+};
+
+constexpr const char *
+algo_name(algo a) noexcept
+{
+	return a == algo::liberation ? "liber8tion"
+		: a == algo::crs ? "crs" : "crs_min";
+}
+
+constexpr unsigned int
+word_size(algo a) noexcept
+{
+	return a == algo::liberation ? 8 : 4;
+}
+
+/** The profiles accepted by rain_get_encoding() */
+constexpr bool
+valid_profile(algo a, unsigned int k, unsigned int m) noexcept
+{
+	if (k < 1 || m < 1)
+		return false;
+	switch (a) {
+		case algo::liberation: return m == 2 && k >= 2 && k <= 7;
+		case algo::crs: return k + m <= (1u << word_size(a));
+		case algo::crs_min: return k >= 2 && k <= 12 && m <= 4;
+	}
+	return false;
+}
+
+/** The sizes rain_get_encoding_ext() sets, computed at compile time */
+struct layout
+{
+	std::size_t packet_size = 0;
+	std::size_t tail_packet_size = 0;
+	std::size_t strip_size = 0;
+	std::size_t block_size = 0;
+	std::size_t padded_data_size = 0;
+};
+
+namespace detail {
+
+constexpr std::size_t packet_sizes[] = {
+	2048, 1024, 512, 256, 128, 64,
+	1792, 896, 448, 224, 112,
+	1536, 768, 384, 192, 96,
+	1280, 640, 320, 160, 80,
+};
+
+constexpr std::size_t
+upper_multiple(std::size_t v, std::size_t m) noexcept
+{
+	return (v % m) ? v + (m - v % m) : v;
+}
+
+constexpr std::size_t
+default_packet_size(std::size_t ds, std::size_t k, std::size_t w) noexcept
+{
+	if (!ds)
+		return 64;
+	if (ds > (k - 1) * k * w * packet_sizes[0])
+		return packet_sizes[0];
+	for (std::size_t p : packet_sizes) {
+		const std::size_t stripe = k * w * p;
+		const std::size_t n = (ds + stripe - 1) / stripe;
+		if (ds >= n * w * p * (k - 1))
+			return p;
+	}
+	return 64;
+}
+
+inline void
+check(int rc)
+{
+	if (!rc)
+		throw std::system_error(errno, std::generic_category(), "librain");
+}
+
+[[noreturn]] inline void
+invalid()
+{
+	throw std::system_error(EINVAL, std::generic_category(), "librain");
+}
+
+} // namespace detail
+
+constexpr layout
+make_layout(std::size_t data_size, unsigned int k, unsigned int w,
+		int flags = 0) noexcept
+{
+	layout l;
+	if (flags & LIBRAIN_TAIL_STRIPE) {
+		l.packet_size = detail::packet_sizes[0];
+		l.strip_size = l.packet_size * w;
+		const std::size_t stripe = k * l.strip_size;
+		const std::size_t full = data_size / stripe;
+		const std::size_t remaining = data_size - (full * stripe);
+		if (remaining > 0 || full == 0) {
+			std::size_t tail = detail::upper_multiple(
+					(remaining + (k * w) - 1) / (k * w), LIBRAIN_TAIL_ALIGN);
+			l.tail_packet_size = tail ? tail : LIBRAIN_TAIL_ALIGN;
+		}
+		l.block_size = (full * l.strip_size) + (w * l.tail_packet_size);
+		l.padded_data_size = k * l.block_size;
+	} else {
+		l.packet_size = detail::default_packet_size(data_size, k, w);
+		l.strip_size = l.packet_size * w;
+		const std::size_t ks = k * l.strip_size;
+		l.padded_data_size = data_size ? detail::upper_multiple(data_size, ks) : ks;
+		l.block_size = l.padded_data_size / k;
+	}
+	return l;
+}
+
+/** The parameters of an object, cf. rain_get_encoding_ext() */
+class encoding
+{
+public:
+	encoding(std::size_t data_size, unsigned int k, unsigned int m, algo a,
+			int flags = 0)
+	{
+		detail::check(rain_get_encoding_ext(&enc_, data_size, k, m,
+					algo_name(a), flags));
+	}
+
+	std::size_t data_size() const noexcept { return enc_.data_size; }
+	std::size_t block_size() const noexcept { return enc_.block_size; }
+	std::size_t padded_data_size() const noexcept { return enc_.padded_data_size; }
+	unsigned int k() const noexcept { return enc_.k; }
+	unsigned int m() const noexcept { return enc_.m; }
+	unsigned int w() const noexcept { return enc_.w; }
+
+	const rain_encoding_s &params() const noexcept { return enc_; }
+	rain_encoding_s *get() noexcept { return &enc_; }
+
+private:
+	rain_encoding_s enc_;
+};
+
+/** A block of bytes owned through an allocator, movable but not copyable */
+template <class Alloc = std::allocator<std::uint8_t>>
+class fragment
+{
+	using traits = std::allocator_traits<Alloc>;
+	static_assert(std::is_same<typename traits::value_type, std::uint8_t>::value,
+			"fragments are made of std::uint8_t");
+
+public:
+	explicit fragment(const Alloc &alloc = Alloc()) noexcept
+		: alloc_(alloc), data_(nullptr), size_(0) {}
+
+	fragment(std::size_t size, const Alloc &alloc = Alloc())
+		: alloc_(alloc), data_(nullptr), size_(0)
+	{
+		if (size > 0)
+			data_ = traits::allocate(alloc_, size);
+		size_ = size;
+	}
+
+	fragment(fragment &&o) noexcept
+		: alloc_(std::move(o.alloc_)), data_(o.data_), size_(o.size_)
+	{
+		o.data_ = nullptr;
+		o.size_ = 0;
+	}
+
+	fragment &operator=(fragment &&o) noexcept
+	{
+		if (this != &o) {
+			release();
+			alloc_ = std::move(o.alloc_);
+			data_ = o.data_;
+			size_ = o.size_;
+			o.data_ = nullptr;
+			o.size_ = 0;
+		}
+		return *this;
+	}
+
+	fragment(const fragment &) = delete;
+	fragment &operator=(const fragment &) = delete;
+
+	~fragment() { release(); }
+
+	std::uint8_t *data() noexcept { return data_; }
+	const std::uint8_t *data() const noexcept { return data_; }
+	std::size_t size() const noexcept { return size_; }
+	bool empty() const noexcept { return size_ == 0; }
+
+	span<std::uint8_t> bytes() noexcept { return span<std::uint8_t>(data_, size_); }
+	span<const std::uint8_t> bytes() const noexcept {
+		return span<const std::uint8_t>(data_, size_);
+	}
+
+private:
+	void release() noexcept
+	{
+		if (data_)
+			traits::deallocate(alloc_, data_, size_);
+		data_ = nullptr;
+		size_ = 0;
+	}
+
+	Alloc alloc_;
+	std::uint8_t *data_;
+	std::size_t size_;
+};
+
+namespace detail {
+
+/* The operations shared by the static and dynamic codecs, on arrays of
+ * k + m entries whatever their container */
+
+/* The valid profiles have at most 16 blocks, cf. valid_profile() */
+constexpr std::size_t max_blocks = 16;
+
+template <class Fragments>
+void
+encode(span<const std::uint8_t> object, encoding &enc, Fragments &out)
+{
+	const std::size_t n = enc.k() + enc.m();
+	std::uint8_t *ptrs[max_blocks];
+	for (std::size_t i = 0; i < n; ++i)
+		ptrs[i] = out[i].data();
+	check(rain_encode_fused(object.data(), object.size(), enc.get(), ptrs, 0));
+}
+
+template <class Blocks>
+void
+encode_parity(encoding &enc, const Blocks &data, std::uint8_t **parity)
+{
+	std::uint8_t *d[max_blocks];
+	for (unsigned int i = 0; i < enc.k(); ++i) {
+		if (data[i].size() < enc.block_size())
+			invalid();
+		d[i] = const_cast<std::uint8_t*>(data[i].data());
+	}
+	check(rain_encode_noalloc(enc.get(), d, parity));
+}
+
+template <class Blocks>
+void
+rehydrate(encoding &enc, const Blocks &blocks, span<std::uint8_t> out)
+{
+	std::uint8_t *ptrs[max_blocks];
+	const std::size_t n = enc.k() + enc.m();
+	for (std::size_t i = 0; i < n; ++i) {
+		if (blocks[i].empty()) {
+			ptrs[i] = nullptr;
+			continue;
+		}
+		if (blocks[i].size() < enc.block_size())
+			invalid();
+		ptrs[i] = const_cast<std::uint8_t*>(blocks[i].data());
+	}
+	struct iovec iov = { out.data(), out.size() };
+	check(rain_rehydrate_iov(ptrs, ptrs + enc.k(), enc.get(), nullptr, &iov, 1));
+}
+
+} // namespace detail
+
+/** A profile fixed at compile time */
+template <algo A, unsigned int K, unsigned int M>
+class codec
+{
+	static_assert(valid_profile(A, K, M), "profile not supported by librain");
+
+public:
+	static constexpr unsigned int k = K;
+	static constexpr unsigned int m = M;
+	static constexpr unsigned int w = word_size(A);
+
+	template <class Alloc = std::allocator<std::uint8_t>>
+	using fragments = std::array<fragment<Alloc>, K + M>;
+
+	static constexpr layout plan(std::size_t data_size, int flags = 0) noexcept {
+		return make_layout(data_size, K, w, flags);
+	}
+
+	static encoding make_encoding(std::size_t data_size, int flags = 0) {
+		return encoding(data_size, K, M, A, flags);
+	}
+
+	/** @return the K data blocks (padded) then the M parity blocks */
+	template <class Alloc = std::allocator<std::uint8_t>>
+	static fragments<Alloc> encode(span<const std::uint8_t> object,
+			int flags = 0, const Alloc &alloc = Alloc())
+	{
+		encoding enc = make_encoding(object.size(), flags);
+		fragments<Alloc> out;
+		for (auto &f : out)
+			f = fragment<Alloc>(enc.block_size(), alloc);
+		detail::encode(object, enc, out);
+		return out;
+	}
+
+	/** Computes the parity of K blocks into M caller blocks, of
+	 * enc.block_size() bytes each */
+	static void encode(encoding &enc,
+			const std::array<span<const std::uint8_t>, K> &data,
+			const std::array<span<std::uint8_t>, M> &parity)
+	{
+		check_encoding(enc);
+		std::uint8_t *p[M];
+		for (unsigned int i = 0; i < M; ++i) {
+			if (parity[i].size() < enc.block_size())
+				detail::invalid();
+			p[i] = parity[i].data();
+		}
+		detail::encode_parity(enc, data, p);
+	}
+
+	/** Writes the object into 'out' from at least K blocks, the missing
+	 * ones being empty spans, a truncated one is invalid */
+	static void rehydrate(encoding &enc,
+			const std::array<span<const std::uint8_t>, K + M> &blocks,
+			span<std::uint8_t> out)
+	{
+		check_encoding(enc);
+		detail::rehydrate(enc, blocks, out);
+	}
+
+private:
+	static void check_encoding(const encoding &enc)
+	{
+		if (enc.k() != K || enc.m() != M || enc.params().algo != rain_algorithm_e(A))
+			detail::invalid();
+	}
+};
+
+/** A profile known at run time */
+class dynamic_codec
+{
+public:
+	dynamic_codec(algo a, unsigned int k, unsigned int m) : algo_(a), k_(k), m_(m)
+	{
+		if (!valid_profile(a, k, m))
+			detail::invalid();
+	}
+
+	unsigned int k() const noexcept { return k_; }
+	unsigned int m() const noexcept { return m_; }
+	unsigned int w() const noexcept { return word_size(algo_); }
+
+	layout plan(std::size_t data_size, int flags = 0) const noexcept {
+		return make_layout(data_size, k_, w(), flags);
+	}
+
+	encoding make_encoding(std::size_t data_size, int flags = 0) const {
+		return encoding(data_size, k_, m_, algo_, flags);
+	}
+
+	template <class Alloc = std::allocator<std::uint8_t>>
+	std::vector<fragment<Alloc>> encode(span<const std::uint8_t> object,
+			int flags = 0, const Alloc &alloc = Alloc()) const
+	{
+		encoding enc = make_encoding(object.size(), flags);
+		std::vector<fragment<Alloc>> out;
+		out.reserve(k_ + m_);
+		for (unsigned int i = 0; i < k_ + m_; ++i)
+			out.emplace_back(enc.block_size(), alloc);
+		detail::encode(object, enc, out);
+		return out;
+	}
+
+	void encode(encoding &enc, const std::vector<span<const std::uint8_t>> &data,
+			const std::vector<span<std::uint8_t>> &parity) const
+	{
+		check_encoding(enc);
+		if (data.size() != k_ || parity.size() != m_)
+			detail::invalid();
+		std::vector<std::uint8_t*> p(m_);
+		for (unsigned int i = 0; i < m_; ++i) {
+			if (parity[i].size() < enc.block_size())
+				detail::invalid();
+			p[i] = parity[i].data();
+		}
+		detail::encode_parity(enc, data, p.data());
+	}
+
+	void rehydrate(encoding &enc,
+			const std::vector<span<const std::uint8_t>> &blocks,
+			span<std::uint8_t> out) const
+	{
+		check_encoding(enc);
+		if (blocks.size() != k_ + m_)
+			detail::invalid();
+		detail::rehydrate(enc, blocks, out);
+	}
+
+private:
+	void check_encoding(const encoding &enc) const
+	{
+		if (enc.k() != k_ || enc.m() != m_
+				|| enc.params().algo != rain_algorithm_e(algo_))
+			detail::invalid();
+	}
+
+	algo algo_;
+	unsigned int k_, m_;
+};
+
+} // namespace rain
+
+#endif // LIBRAIN_HPP
@@ -0,0 +1,116 @@
+#include <stdlib.h>
+
+#include "rain_cauchy.h"
+
+#define CAUCHY_MAX_KM 48
+
+struct cauchy_min_s
+{
+	unsigned int k, m, w;
+	int matrix[CAUCHY_MAX_KM];
+};
+
+/* Output of "rain_cauchy_search 4 2-12 1-4". The matrices are part of the
+ * "crs_min" format: an entry can be added, never changed. */
+static const struct cauchy_min_s cauchy_min[] =
+{
+	/* 2+1 w=4: 8 ones, cauchy_good 8, 105 tried */
+	{ 2, 1, 4, {1,1} },
+	/* 2+2 w=4: 17 ones, cauchy_good 21, 1365 tried */
+	{ 2, 2, 4, {1,1,2,1} },
+	/* 2+3 w=4: 26 ones, cauchy_good 35, 8190 tried */
+	{ 2, 3, 4, {9,1,1,1,1,9} },
+	/* 2+4 w=4: 36 ones, cauchy_good 41, 30030 tried */
+	{ 2, 4, 4, {1,1,1,4,1,2,1,9} },
+	/* 3+1 w=4: 12 ones, cauchy_good 12, 455 tried */
+	{ 3, 1, 4, {1,1,1} },
+	/* 3+2 w=4: 26 ones, cauchy_good 35, 5460 tried */
+	{ 3, 2, 4, {1,1,1,2,9,1} },
+	/* 3+3 w=4: 43 ones, cauchy_good 50, 30030 tried */
+	{ 3, 3, 4, {1,9,1,1,1,9,13,4,1} },
+	/* 3+4 w=4: 58 ones, cauchy_good 74, 100100 tried */
+	{ 3, 4, 4, {2,9,1,2,1,9,9,4,1,9,1,4} },
+	/* 4+1 w=4: 16 ones, cauchy_good 16, 1365 tried */
+	{ 4, 1, 4, {1,1,1,1} },
+	/* 4+2 w=4: 36 ones, cauchy_good 46, 15015 tried */
+	{ 4, 2, 4, {1,1,1,1,4,9,1,2} },
+	/* 4+3 w=4: 58 ones, cauchy_good 73, 75075 tried */
+	{ 4, 3, 4, {9,2,2,9,4,9,1,1,1,1,9,4} },
+	/* 4+4 w=4: 80 ones, cauchy_good 98, 225225 tried */
+	{ 4, 4, 4, {9,1,4,9,2,1,1,8,8,1,9,1,1,8,1,9} },
+	/* 5+1 w=4: 20 ones, cauchy_good 20, 3003 tried */
+	{ 5, 1, 4, {1,1,1,1,1} },
+	/* 5+2 w=4: 46 ones, cauchy_good 57, 30030 tried */
+	{ 5, 2, 4, {1,2,1,1,1,2,9,9,1,4} },
+	/* 5+3 w=4: 75 ones, cauchy_good 90, 135135 tried */
+	{ 5, 3, 4, {9,2,9,1,2,1,9,4,1,1,4,1,1,6,9} },
+	/* 5+4 w=4: 105 ones, cauchy_good 127, 360360 tried */
+	{ 5, 4, 4, {2,1,1,8,13,9,1,4,9,2,8,1,9,1,12,1,8,1,9,1} },
+	/* 6+1 w=4: 24 ones, cauchy_good 24, 5005 tried */
+	{ 6, 1, 4, {1,1,1,1,1,1} },
+	/* 6+2 w=4: 57 ones, cauchy_good 68, 45045 tried */
+	{ 6, 2, 4, {1,1,1,1,1,2,4,9,1,2,8,9} },
+	/* 6+3 w=4: 92 ones, cauchy_good 109, 180180 tried */
+	{ 6, 3, 4, {9,2,9,1,1,2,1,9,4,6,1,1,4,1,1,1,6,9} },
+	/* 6+4 w=4: 131 ones, cauchy_good 157, 420420 tried */
+	{ 6, 4, 4, {1,1,9,9,8,9,5,9,1,4,1,8,1,5,4,8,1,1,9,1,8,1,1,4} },
+	/* 7+1 w=4: 28 ones, cauchy_good 28, 6435 tried */
+	{ 7, 1, 4, {1,1,1,1,1,1,1} },
+	/* 7+2 w=4: 69 ones, cauchy_good 76, 51480 tried */
+	{ 7, 2, 4, {1,1,8,1,1,1,2,4,9,9,1,2,8,9} },
+	/* 7+3 w=4: 112 ones, cauchy_good 130, 180180 tried */
+	{ 7, 3, 4, {1,12,4,1,1,9,1,12,1,1,9,6,1,4,9,9,1,4,2,4,1} },
+	/* 7+4 w=4: 154 ones, cauchy_good 187, 360360 tried */
+	{ 7, 4, 4, {1,1,1,9,9,8,9,5,9,1,1,4,1,8,1,5,9,4,8,1,1,9,1,5,8,1,1,4} },
+	/* 8+1 w=4: 32 ones, cauchy_good 32, 6435 tried */
+	{ 8, 1, 4, {1,1,1,1,1,1,1,1} },
+	/* 8+2 w=4: 81 ones, cauchy_good 90, 45045 tried */
+	{ 8, 2, 4, {1,1,8,1,1,1,2,9,4,9,9,1,2,8,9,8} },
+	/* 8+3 w=4: 130 ones, cauchy_good 147, 135135 tried */
+	{ 8, 3, 4, {1,12,4,1,1,9,3,1,12,1,1,9,6,1,9,4,9,9,1,4,2,4,1,1} },
+	/* 8+4 w=4: 184 ones, cauchy_good 213, 225225 tried */
+	{ 8, 4, 4, {1,1,1,4,9,9,8,9,5,9,1,15,1,4,1,8,1,5,9,1,4,8,1,1,9,1,5,5,8,1,1,4} },
+	/* 9+1 w=4: 36 ones, cauchy_good 36, 5005 tried */
+	{ 9, 1, 4, {1,1,1,1,1,1,1,1,1} },
+	/* 9+2 w=4: 93 ones, cauchy_good 101, 30030 tried */
+	{ 9, 2, 4, {1,1,1,12,1,1,2,4,9,4,9,1,1,2,8,9,9,8} },
+	/* 9+3 w=4: 151 ones, cauchy_good 172, 75075 tried */
+	{ 9, 3, 4, {1,12,4,9,1,1,9,3,1,12,1,1,12,9,6,1,9,4,9,9,1,8,4,2,4,1,1} },
+	/* 9+4 w=4: 214 ones, cauchy_good 239, 100100 tried */
+	{ 9, 4, 4, {13,1,9,1,1,4,1,13,12,4,2,9,9,12,9,5,2,1,4,6,5,2,9,1,1,1,8,1,13,4,12,1,11,9,4,9} },
+	/* 10+1 w=4: 40 ones, cauchy_good 40, 3003 tried */
+	{ 10, 1, 4, {1,1,1,1,1,1,1,1,1,1} },
+	/* 10+2 w=4: 106 ones, cauchy_good 117, 15015 tried */
+	{ 10, 2, 4, {1,1,1,1,2,4,9,1,1,1,6,4,9,8,9,9,8,12,2,1} },
+	/* 10+3 w=4: 171 ones, cauchy_good 193, 30030 tried */
+	{ 10, 3, 4, {1,1,13,2,8,12,2,1,5,9,4,9,2,9,1,2,4,1,1,5,9,1,8,6,9,9,13,8,1,1} },
+	/* 10+4 w=4: 240 ones, cauchy_good 268, 30030 tried */
+	{ 10, 4, 4, {13,1,5,1,1,1,8,1,9,12,4,2,13,1,9,12,1,5,4,1,2,3,4,5,1,13,1,9,1,4,1,13,1,8,12,1,5,9,8,9} },
+	/* 11+1 w=4: 44 ones, cauchy_good 44, 1365 tried */
+	{ 11, 1, 4, {1,1,1,1,1,1,1,1,1,1,1} },
+	/* 11+2 w=4: 119 ones, cauchy_good 129, 5460 tried */
+	{ 11, 2, 4, {1,1,1,8,1,1,1,2,4,9,1,4,5,9,9,1,2,8,9,9,8,12} },
+	/* 11+3 w=4: 193 ones, cauchy_good 213, 8190 tried */
+	{ 11, 3, 4, {1,1,13,2,8,9,12,2,1,5,9,4,9,2,9,1,8,2,4,1,1,5,9,1,8,6,9,5,9,13,8,1,1} },
+	/* 11+4 w=4: 268 ones, cauchy_good 303, 5460 tried */
+	{ 11, 4, 4, {5,9,1,1,1,1,4,9,8,5,2,1,8,2,1,9,12,9,4,6,4,15,8,1,15,4,6,9,12,4,9,1,2,9,5,2,5,8,4,1,9,1,1,1} },
+	/* 12+1 w=4: 48 ones, cauchy_good 48, 455 tried */
+	{ 12, 1, 4, {1,1,1,1,1,1,1,1,1,1,1,1} },
+	/* 12+2 w=4: 132 ones, cauchy_good 139, 1365 tried */
+	{ 12, 2, 4, {1,1,1,8,1,12,1,1,2,4,9,1,4,5,9,9,1,1,2,8,9,9,8,12} },
+	/* 12+3 w=4: 213 ones, cauchy_good 234, 1365 tried */
+	{ 12, 3, 4, {9,5,1,1,12,9,9,1,2,2,9,4,2,2,9,1,2,1,12,8,9,13,8,5,2,1,12,3,9,5,4,13,1,2,1,9} },
+	/* 12+4 w=4: 305 ones, cauchy_good 334, 455 tried */
+	{ 12, 4, 4, {1,5,9,2,1,9,13,2,1,4,1,4,1,9,4,5,4,1,12,1,6,12,14,1,1,2,5,1,13,3,2,8,12,9,2,15,6,4,1,15,5,4,1,9,1,9,11,2} },
+	{ 0, 0, 0, {0} }
+};
+
+const int *
+rain_cauchy_min_matrix(unsigned int k, unsigned int m, unsigned int w)
+{
+	for (const struct cauchy_min_s *c = cauchy_min; c->k > 0; ++c) {
+		if (c->k == k && c->m == m && c->w == w)
+			return c->matrix;
+	}
+	return NULL;
+}
@@ -0,0 +1,11 @@
+#ifndef LIBRAIN_rain_cauchy_h
+#define LIBRAIN_rain_cauchy_h 1
+
+/** Returns the k*m Cauchy coding matrix over GF(2^w) found by
+ * rain_cauchy_search with the fewest ones in its bitmatrix, i.e. the
+ * fewest XORs per strip. Used by the "crs_min" algorithm.
+ * @return NULL if the profile is not in the table */
+const int* rain_cauchy_min_matrix (unsigned int k, unsigned int m,
+		unsigned int w);
+
+#endif // LIBRAIN_rain_cauchy_h
@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <jerasure/galois.h>
+#include <jerasure/cauchy.h>
+
+/* Searches the Cauchy coding matrices whose bitmatrix has the fewest ones,
+ * i.e. the fewest XORs per strip, and prints them as entries for the
+ * table of rain_cauchy.c.
+ *
+ * A Cauchy matrix is set by two disjoint sets X (m elements) and Y
+ * (k elements) of GF(2^w), with M[i][j] = 1 / (X[i] + Y[j]). Its rows and
+ * columns can then be multiplied by any non-zero factor, the matrix
+ * remains MDS. All the sets are tried when there are few enough of them,
+ * otherwise a random local search is run. Translating both sets by the
+ * same element gives the same matrix, so X[0] is 0. For each set, the
+ * scaling is optimized row by row then column by column until it
+ * converges. */
+
+#define MAX_W 8
+#define MAX_KM 64
+
+struct search_s
+{
+	unsigned int k, m, w, n;
+	int ones[1 << MAX_W]; /**< ones in the bitmatrix of each element */
+	int mul[1 << MAX_W][1 << MAX_W];
+	int inv[1 << MAX_W];
+
+	int best_score;
+	int best[MAX_KM];
+	unsigned long tried;
+};
+
+static void
+_search_init (struct search_s *s, unsigned int k, unsigned int m, unsigned int w)
+{
+	memset (s, 0, sizeof(*s));
+	s->k = k, s->m = m, s->w = w, s->n = 1U << w;
+	for (unsigned int a = 0; a < s->n; ++a) {
+		for (unsigned int b = 0; b < s->n; ++b)
+			s->mul[a][b] = galois_single_multiply (a, b, w);
+		s->ones[a] = a ? cauchy_n_ones (a, w) : 0;
+		s->inv[a] = a ? galois_single_divide (1, a, w) : 0;
+	}
+	s->best_score = -1;
+}
+
+static int
+_row_scale (struct search_s *s, int *mat, unsigned int i)
+{
+	int best = -1, best_f = 1;
+	for (unsigned int f = 1; f < s->n; ++f) {
+		int score = 0;
+		for (unsigned int j = 0; j < s->k; ++j)
+			score += s->ones[s->mul[mat[i * s->k + j]][f]];
+		if (best < 0 || score < best)
+			best = score, best_f = f;
+	}
+	for (unsigned int j = 0; j < s->k; ++j)
+		mat[i * s->k + j] = s->mul[mat[i * s->k + j]][best_f];
+	return best;
+}
+
+static int
+_col_scale (struct search_s *s, int *mat, unsigned int j)
+{
+	int best = -1, best_f = 1;
+	for (unsigned int f = 1; f < s->n; ++f) {
+		int score = 0;
+		for (unsigned int i = 0; i < s->m; ++i)
+			score += s->ones[s->mul[mat[i * s->k + j]][f]];
+		if (best < 0 || score < best)
+			best = score, best_f = f;
+	}
+	for (unsigned int i = 0; i < s->m; ++i)
+		mat[i * s->k + j] = s->mul[mat[i * s->k + j]][best_f];
+	return best;
+}
+
+static int
+_score (struct search_s *s, const int *mat)
+{
+	int score = 0;
+	for (unsigned int i = 0; i < s->k * s->m; ++i)
+		score += s->ones[mat[i]];
+	return score;
+}
+
+/* Builds and scales the matrix of the sets, keeps it if it is the best */
+static int
+_evaluate (struct search_s *s, const int *X, const int *Y)
+{
+	int mat[MAX_KM];
+	for (unsigned int i = 0; i < s->m; ++i) {
+		for (unsigned int j = 0; j < s->k; ++j)
+			mat[i * s->k + j] = s->inv[X[i] ^ Y[j]];
+	}
+
+	// First row full of 1, then alternate until nothing improves
+	for (unsigned int j = 0; j < s->k; ++j) {
+		int f = s->inv[mat[j]];
+		for (unsigned int i = 0; i < s->m; ++i)
+			mat[i * s->k + j] = s->mul[mat[i * s->k + j]][f];
+	}
+	int score = _score (s, mat);
+	for (;;) {
+		for (unsigned int i = 1; i < s->m; ++i)
+			_row_scale (s, mat, i);
+		for (unsigned int j = 0; j < s->k; ++j)
+			_col_scale (s, mat, j);
+		int next = _score (s, mat);
+		if (next >= score)
+			break;
+		score = next;
+	}
+
+	s->tried ++;
+	if (s->best_score < 0 || score < s->best_score) {
+		s->best_score = score;
+		memcpy (s->best, mat, s->k * s->m * sizeof(int));
+	}
+	return score;
+}
+
+/* Enumerates the combinations of 'count' elements among the unused ones */
+static void
+_enumerate_Y (struct search_s *s, int *X, int *Y, unsigned int count,
+		unsigned int next, int *used)
+{
+	if (count == s->k) {
+		_evaluate (s, X, Y);
+		return;
+	}
+	for (unsigned int e = next; e < s->n; ++e) {
+		if (used[e])
+			continue;
+		Y[count] = e;
+		_enumerate_Y (s, X, Y, count + 1, e + 1, used);
+	}
+}
+
+static void
+_enumerate_X (struct search_s *s, int *X, int *Y, unsigned int count,
+		unsigned int next, int *used)
+{
+	if (count == s->m) {
+		_enumerate_Y (s, X, Y, 0, 0, used);
+		return;
+	}
+	for (unsigned int e = next; e < s->n; ++e) {
+		X[count] = e;
+		used[e] = 1;
+		_enumerate_X (s, X, Y, count + 1, e + 1, used);
+		used[e] = 0;
+	}
+}
+
+static double
+_binomial (unsigned int n, unsigned int p)
+{
+	double r = 1.0;
+	for (unsigned int i = 1; i <= p; ++i)
+		r = r * (double)(n - p + i) / (double)i;
+	return r;
+}
+
+static void
+_local_search (struct search_s *s, unsigned long iterations)
+{
+	int perm[1 << MAX_W];
+	srandom (s->k * 1000 + s->m * 10 + s->w);
+
+	for (unsigned long restart = 0; restart < 16; ++restart) {
+		// perm[0..m-1] is X, perm[m..m+k-1] is Y, the remaining are unused
+		for (unsigned int i = 0; i < s->n; ++i)
+			perm[i] = i;
+		for (unsigned int i = s->n - 1; i > 1; --i) {
+			unsigned int j = 1 + random () % i;
+			int tmp = perm[i]; perm[i] = perm[j]; perm[j] = tmp;
+		}
+		int current = _evaluate (s, perm, perm + s->m);
+		for (unsigned long it = 0; it < iterations / 16; ++it) {
+			unsigned int a = 1 + random () % (s->m + s->k - 1);
+			unsigned int b = s->m + s->k + random () % (s->n - s->m - s->k + 1);
+			if (b >= s->n)
+				b = 1 + random () % (s->m + s->k - 1);
+			int tmp = perm[a]; perm[a] = perm[b]; perm[b] = tmp;
+			int score = _evaluate (s, perm, perm + s->m);
+			if (score <= current)
+				current = score;
+			else {
+				tmp = perm[a]; perm[a] = perm[b]; perm[b] = tmp;
+			}
+		}
+	}
+}
+
+static void
+_search (unsigned int k, unsigned int m, unsigned int w,
+		unsigned long iterations)
+{
+	static struct search_s s;
+	_search_init (&s, k, m, w);
+
+	int X[MAX_KM], Y[MAX_KM], used[1 << MAX_W];
+	memset (used, 0, sizeof(used));
+	double space = _binomial (s.n - 1, m - 1) * _binomial (s.n - m, k);
+	if (space <= (double) iterations) {
+		X[0] = 0;
+		used[0] = 1;
+		_enumerate_X (&s, X, Y, 1, 1, used);
+	} else {
+		_local_search (&s, iterations);
+	}
+
+	int *good = cauchy_good_general_coding_matrix (k, m, w);
+	int reference = _score (&s, good);
+	free (good);
+
+	printf ("\t/* %u+%u w=%u: %d ones, cauchy_good %d, %lu tried */\n",
+			k, m, w, s.best_score, reference, s.tried);
+	printf ("\t{ %u, %u, %u, {", k, m, w);
+	for (unsigned int i = 0; i < k * m; ++i)
+		printf ("%s%d", i ? "," : "", s.best[i]);
+	printf ("} },\n");
+	fflush (stdout);
+}
+
+int
+main (int argc, char **argv)
+{
+	if (argc < 4) {
+		fprintf (stderr, "Usage: %s W K_MIN-K_MAX M_MIN-M_MAX [ITERATIONS]\n",
+				argv[0]);
+		return 1;
+	}
+
+	unsigned int w = atoi (argv[1]);
+	unsigned int kmin = 0, kmax = 0, mmin = 0, mmax = 0;
+	unsigned long iterations = 1000000;
+	if (sscanf (argv[2], "%u-%u", &kmin, &kmax) == 1)
+		kmax = kmin;
+	if (sscanf (argv[3], "%u-%u", &mmin, &mmax) == 1)
+		mmax = mmin;
+	if (argc > 4)
+		iterations = strtoul (argv[4], NULL, 10);
+	if ((w != 4 && w != 8) || !kmin || !mmin || kmin > kmax || mmin > mmax) {
+		fprintf (stderr, "Invalid parameters\n");
+		return 1;
+	}
+
+	for (unsigned int k = kmin; k <= kmax; ++k) {
+		for (unsigned int m = mmin; m <= mmax; ++m) {
+			if (k * m > MAX_KM || k + m > (1U << w))
+				continue;
+			_search (k, m, w, iterations);
+		}
+	}
+	return 0;
+}
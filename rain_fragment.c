@@ -0,0 +1,469 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "librain.h"
+#include "rain_fragment.h"
+#include "utils.h"
+#include "rain_io.h"
+
+static const char fragment_MAGIC[8] = { 'R','A','I','N','F','R','A','G' };
+
+/* Offsets of the fields of the header */
+#define OFF_MAGIC 0
+#define OFF_VERSION 8
+#define OFF_ALGO 12
+#define OFF_K 16
+#define OFF_M 20
+#define OFF_W 24
+#define OFF_INDEX 28
+#define OFF_DATA_SIZE 32
+#define OFF_PACKET_SIZE 40
+#define OFF_TAIL_PACKET_SIZE 48
+#define OFF_BLOCK_SIZE 56
+#define OFF_STRIPES 64
+#define OFF_BLOCK 68
+#define OFF_ID 72
+#define OFF_CRC 88
+
+/* CRC32C (Castagnoli), reflected polynomial 0x82F63B78 */
+static const uint32_t crc32c_table[256] = {
+	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+	0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+	0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+	0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+	0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+	0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+	0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+	0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+	0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+	0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+	0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+	0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+	0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+	0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+	0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+	0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+	0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+	0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+	0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+	0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+	0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+	0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+	0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+	0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+	0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+	0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+	0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+	0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+	0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+	0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+	0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+	0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+	0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+	0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+	0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+	0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+	0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+	0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+	0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+	0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+	0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351
+};
+
+struct rain_fragment_s
+{
+	struct rain_encoding_s enc;
+	unsigned int index;
+	unsigned int nb_stripes;
+	uint8_t id[RAIN_FRAGMENT_ID];
+	const uint8_t *entries; /**< The stripe index, in place */
+	const uint8_t *block;
+
+	const uint8_t *base;
+	size_t length;
+	int mapped;
+};
+
+uint32_t
+rain_crc32c(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	crc = ~crc;
+	while (len--)
+		crc = crc32c_table[(crc ^ *(buf++)) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static unsigned int
+_count_stripes(const struct rain_encoding_s *enc)
+{
+	const size_t tail = enc->w * enc->tail_packet_size;
+	return (enc->block_size - tail) / enc->strip_size + (tail ? 1 : 0);
+}
+
+/* The offset and size of the strip of a stripe, in the block */
+static void
+_locate_strip(const struct rain_encoding_s *enc, unsigned int stripe,
+		size_t *offset, size_t *size)
+{
+	const size_t tail = enc->w * enc->tail_packet_size;
+	const size_t head = (enc->block_size - tail) / enc->strip_size;
+	if (stripe < head) {
+		*offset = stripe * enc->strip_size;
+		*size = enc->strip_size;
+	} else {
+		*offset = enc->block_size - tail;
+		*size = tail;
+	}
+}
+
+size_t
+rain_fragment_header_size(const struct rain_encoding_s *enc)
+{
+	assert(enc != NULL);
+	size_t len = RAIN_FRAGMENT_HEADER
+		+ (_count_stripes(enc) * RAIN_FRAGMENT_INDEX_ENTRY);
+	return _upper_multiple(len, RAIN_FRAGMENT_ALIGN);
+}
+
+size_t
+rain_fragment_size(const struct rain_encoding_s *enc)
+{
+	return rain_fragment_header_size(enc) + enc->block_size;
+}
+
+int
+rain_fragment_format(const struct rain_encoding_s *enc, unsigned int index,
+		const uint8_t *id, const uint8_t *block, uint8_t *out)
+{
+	assert(enc != NULL);
+	assert(block != NULL);
+	assert(out != NULL);
+
+	if (index >= enc->k + enc->m || !rain_algorithm_name(enc->algo)) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	const size_t hlen = rain_fragment_header_size(enc);
+	const unsigned int nb_stripes = _count_stripes(enc);
+	memset(out, 0, hlen);
+
+	memcpy(out + OFF_MAGIC, fragment_MAGIC, sizeof(fragment_MAGIC));
+	_put32(out + OFF_VERSION, RAIN_FRAGMENT_VERSION);
+	_put32(out + OFF_ALGO, enc->algo);
+	_put32(out + OFF_K, enc->k);
+	_put32(out + OFF_M, enc->m);
+	_put32(out + OFF_W, enc->w);
+	_put32(out + OFF_INDEX, index);
+	_put64(out + OFF_DATA_SIZE, enc->data_size);
+	_put64(out + OFF_PACKET_SIZE, enc->packet_size);
+	_put64(out + OFF_TAIL_PACKET_SIZE, enc->tail_packet_size);
+	_put64(out + OFF_BLOCK_SIZE, enc->block_size);
+	_put32(out + OFF_STRIPES, nb_stripes);
+	_put32(out + OFF_BLOCK, hlen);
+	if (id)
+		memcpy(out + OFF_ID, id, RAIN_FRAGMENT_ID);
+
+	uint8_t *entry = out + RAIN_FRAGMENT_HEADER;
+	for (unsigned int s = 0; s < nb_stripes; ++s) {
+		size_t offset, size;
+		_locate_strip(enc, s, &offset, &size);
+		_put64(entry, offset);
+		_put32(entry + 8, size);
+		_put32(entry + 12, rain_crc32c(0, block + offset, size));
+		entry += RAIN_FRAGMENT_INDEX_ENTRY;
+	}
+
+	// The CRC covers the header (with a zero CRC) and the stripe index
+	_put32(out + OFF_CRC, rain_crc32c(0, out, hlen));
+	return 1;
+}
+
+int
+rain_fragment_write(const char *path, const struct rain_encoding_s *enc,
+		unsigned int index, const uint8_t *id, const uint8_t *block)
+{
+	assert(path != NULL);
+	assert(enc != NULL);
+
+	const size_t hlen = rain_fragment_header_size(enc);
+	uint8_t *header = malloc(hlen);
+	if (!header) {
+		errno = ENOMEM;
+		return 0;
+	}
+	if (!rain_fragment_format(enc, index, id, block, header)) {
+		free(header);
+		return 0;
+	}
+
+	int rc = 0, fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fd >= 0) {
+		rc = _write_full(fd, header, hlen)
+			&& _write_full(fd, block, enc->block_size);
+		int errsave = errno;
+		if (close(fd) < 0 && rc)
+			rc = 0;
+		else
+			errno = errsave;
+	}
+	free(header);
+	return rc;
+}
+
+static int
+_parse(struct rain_fragment_s *f, int flags)
+{
+	const uint8_t *b = f->base;
+	if (f->length < RAIN_FRAGMENT_HEADER
+			|| memcmp(b + OFF_MAGIC, fragment_MAGIC, sizeof(fragment_MAGIC))
+			|| _get32(b + OFF_VERSION) != RAIN_FRAGMENT_VERSION) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	// Rebuild the encoding, the layout must be the one librain computes.
+	// The counts of blocks are bounded first, they size arrays on the stack.
+	const char *algo = rain_algorithm_name(_get32(b + OFF_ALGO));
+	const unsigned int k = _get32(b + OFF_K), m = _get32(b + OFF_M);
+	const uint64_t data_size = _get64(b + OFF_DATA_SIZE);
+	const uint64_t tail_packet_size = _get64(b + OFF_TAIL_PACKET_SIZE);
+	if (!algo || !k || !m || k > 64 || m > 64 || k + m > 64
+			|| !rain_get_encoding_ext(&f->enc, data_size, k, m,
+				algo, tail_packet_size ? LIBRAIN_TAIL_STRIPE : 0)
+			|| f->enc.w >= 32 || k + m > (1u << f->enc.w)) {
+		errno = EINVAL;
+		return 0;
+	}
+	f->index = _get32(b + OFF_INDEX);
+	f->nb_stripes = _get32(b + OFF_STRIPES);
+	const size_t hlen = rain_fragment_header_size(&f->enc);
+	if (f->enc.w != _get32(b + OFF_W)
+			|| f->enc.packet_size != _get64(b + OFF_PACKET_SIZE)
+			|| f->enc.tail_packet_size != tail_packet_size
+			|| f->enc.block_size != _get64(b + OFF_BLOCK_SIZE)
+			|| f->index >= f->enc.k + f->enc.m
+			|| f->nb_stripes != _count_stripes(&f->enc)
+			|| _get32(b + OFF_BLOCK) != hlen
+			|| f->length < hlen + f->enc.block_size) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	uint8_t zero[4] = {0};
+	uint32_t crc = rain_crc32c(0, b, OFF_CRC);
+	crc = rain_crc32c(crc, zero, 4);
+	crc = rain_crc32c(crc, b + OFF_CRC + 4, hlen - OFF_CRC - 4);
+	if (crc != _get32(b + OFF_CRC)) {
+		errno = EBADMSG;
+		return 0;
+	}
+
+	memcpy(f->id, b + OFF_ID, RAIN_FRAGMENT_ID);
+	f->entries = b + RAIN_FRAGMENT_HEADER;
+	f->block = b + hlen;
+	for (unsigned int s = 0; s < f->nb_stripes; ++s) {
+		size_t offset, size;
+		const uint8_t *entry = f->entries + (s * RAIN_FRAGMENT_INDEX_ENTRY);
+		_locate_strip(&f->enc, s, &offset, &size);
+		if (_get64(entry) != offset || _get32(entry + 8) != size) {
+			errno = EINVAL;
+			return 0;
+		}
+		if ((flags & RAIN_FRAGMENT_VERIFY) && !rain_fragment_verify_stripe(f, s))
+			return 0;
+	}
+	return 1;
+}
+
+struct rain_fragment_s *
+rain_fragment_open_buffer(const uint8_t *buf, size_t len, int flags)
+{
+	assert(buf != NULL);
+
+	struct rain_fragment_s *f = calloc(1, sizeof(*f));
+	if (!f) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	f->base = buf;
+	f->length = len;
+	if (!_parse(f, flags)) {
+		free(f);
+		return NULL;
+	}
+	return f;
+}
+
+struct rain_fragment_s *
+rain_fragment_open(const char *path, int flags)
+{
+	assert(path != NULL);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int errsave = errno;
+		close(fd);
+		errno = errsave;
+		return NULL;
+	}
+	if (st.st_size < RAIN_FRAGMENT_HEADER) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	struct rain_fragment_s *f = rain_fragment_open_buffer(base, st.st_size,
+			flags);
+	if (!f) {
+		int errsave = errno;
+		munmap(base, st.st_size);
+		errno = errsave;
+		return NULL;
+	}
+	f->mapped = 1;
+	return f;
+}
+
+void
+rain_fragment_close(struct rain_fragment_s *f)
+{
+	if (!f)
+		return;
+	if (f->mapped)
+		munmap((void*) f->base, f->length);
+	free(f);
+}
+
+const struct rain_encoding_s *
+rain_fragment_encoding(const struct rain_fragment_s *f)
+{
+	assert(f != NULL);
+	return &f->enc;
+}
+
+unsigned int
+rain_fragment_index(const struct rain_fragment_s *f)
+{
+	assert(f != NULL);
+	return f->index;
+}
+
+const uint8_t *
+rain_fragment_id(const struct rain_fragment_s *f)
+{
+	assert(f != NULL);
+	return f->id;
+}
+
+const uint8_t *
+rain_fragment_block(const struct rain_fragment_s *f)
+{
+	assert(f != NULL);
+	return f->block;
+}
+
+unsigned int
+rain_fragment_stripes(const struct rain_fragment_s *f)
+{
+	assert(f != NULL);
+	return f->nb_stripes;
+}
+
+int
+rain_fragment_verify_stripe(const struct rain_fragment_s *f,
+		unsigned int stripe)
+{
+	assert(f != NULL);
+	if (stripe >= f->nb_stripes) {
+		errno = EINVAL;
+		return 0;
+	}
+	const uint8_t *entry = f->entries + (stripe * RAIN_FRAGMENT_INDEX_ENTRY);
+	const size_t offset = _get64(entry), size = _get32(entry + 8);
+	if (rain_crc32c(0, f->block + offset, size) != _get32(entry + 12)) {
+		errno = EBADMSG;
+		return 0;
+	}
+	return 1;
+}
+
+static int
+_same_encoding(const struct rain_encoding_s *a, const struct rain_encoding_s *b)
+{
+	return a->algo == b->algo && a->k == b->k && a->m == b->m && a->w == b->w
+		&& a->data_size == b->data_size && a->packet_size == b->packet_size
+		&& a->tail_packet_size == b->tail_packet_size
+		&& a->block_size == b->block_size;
+}
+
+int
+rain_fragment_blocks(struct rain_fragment_s **fragments, unsigned int count,
+		struct rain_encoding_s *enc, uint8_t **data, uint8_t **parity)
+{
+	assert(fragments != NULL);
+	assert(enc != NULL);
+	assert(data != NULL);
+	assert(parity != NULL);
+
+	if (!count) {
+		errno = EINVAL;
+		return 0;
+	}
+	*enc = fragments[0]->enc;
+	for (unsigned int i = 0; i < enc->k; ++i)
+		data[i] = NULL;
+	for (unsigned int i = 0; i < enc->m; ++i)
+		parity[i] = NULL;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		const struct rain_fragment_s *f = fragments[i];
+		if (!_same_encoding(&f->enc, enc)
+				|| memcmp(f->id, fragments[0]->id, RAIN_FRAGMENT_ID)) {
+			errno = EINVAL;
+			return 0;
+		}
+		uint8_t **slot = (f->index < enc->k)
+			? data + f->index : parity + (f->index - enc->k);
+		if (*slot) {
+			errno = EINVAL;
+			return 0;
+		}
+		*slot = (uint8_t*) f->block;
+	}
+	return 1;
+}
+
+int
+rain_fragment_rehydrate(struct rain_fragment_s **fragments,
+		unsigned int count, struct rain_env_s *env,
+		const struct iovec *iov, int iovcnt)
+{
+	assert(fragments != NULL);
+
+	if (!count) {
+		errno = EINVAL;
+		return 0;
+	}
+	const struct rain_encoding_s *first = &fragments[0]->enc;
+	struct rain_encoding_s enc;
+	uint8_t *data[first->k], *parity[first->m];
+	if (!rain_fragment_blocks(fragments, count, &enc, data, parity))
+		return 0;
+	return rain_rehydrate_iov(data, parity, &enc, env, iov, iovcnt);
+}
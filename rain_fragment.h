@@ -0,0 +1,144 @@
+#ifndef LIBRAIN_rain_fragment_h
+#define LIBRAIN_rain_fragment_h 1
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include "librain.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Self-describing fragments: each block is stored with the parameters of
+ * its encoding, so that any k fragments of an object are enough to
+ * rebuild it, with no external metadata.
+ *
+ * A fragment is laid out as follows, all the integers in little endian:
+ *
+ *   header   RAIN_FRAGMENT_HEADER bytes
+ *            magic "RAINFRAG", version, algo, k, m, w, the fragment index,
+ *            data_size, packet_size, tail_packet_size, block_size, the
+ *            number of stripes, the object id, the offset of the block
+ *            and the CRC32C of the header and of the stripe index.
+ *   index    one entry per stripe: the offset of its strip in the block,
+ *            the size of the strip, and the CRC32C of the strip.
+ *   padding  up to a multiple of RAIN_FRAGMENT_ALIGN
+ *   block    block_size bytes
+ *
+ * The block is left in place, thus a mapped fragment directly gives the
+ * block pointers expected by rain_rehydrate() and friends.
+ */
+
+#define RAIN_FRAGMENT_VERSION 1
+
+/** The size of the fixed part of the header */
+#define RAIN_FRAGMENT_HEADER 96
+
+/** The size of each entry of the stripe index */
+#define RAIN_FRAGMENT_INDEX_ENTRY 16
+
+/** The offset of the block is a multiple of this */
+#define RAIN_FRAGMENT_ALIGN 64
+
+/** Size of the identifier shared by all the fragments of an object */
+#define RAIN_FRAGMENT_ID 16
+
+/** Open option: check the checksum of every strip */
+#define RAIN_FRAGMENT_VERIFY 0x01
+
+/** A fragment opened for reading */
+struct rain_fragment_s;
+
+/** @return the number of bytes preceding the block in a fragment */
+size_t rain_fragment_header_size (const struct rain_encoding_s *enc);
+
+/** @return the total size of a fragment */
+size_t rain_fragment_size (const struct rain_encoding_s *enc);
+
+/** @return the CRC32C of 'len' bytes, continuing 'crc' (0 to start) */
+uint32_t rain_crc32c (uint32_t crc, const uint8_t *buf, size_t len);
+
+/** Writes the header and the stripe index of a fragment.
+ *
+ * @param enc cannot be NULL
+ * @param index the index of the block, 0 to enc->k+enc->m-1
+ * @param id RAIN_FRAGMENT_ID bytes identifying the object, can be NULL
+ * @param block the content of the block, enc->block_size bytes
+ * @param out must be rain_fragment_header_size(enc) bytes long
+ * @return a boolean value, false if it failed (errno is set)
+ */
+int rain_fragment_format (const struct rain_encoding_s *enc,
+		unsigned int index, const uint8_t *id, const uint8_t *block,
+		uint8_t *out);
+
+/** Writes a whole fragment in a new file (or truncates an existing one).
+ * @see rain_fragment_format()
+ * @return a boolean value, false if it failed (errno is set)
+ */
+int rain_fragment_write (const char *path, const struct rain_encoding_s *enc,
+		unsigned int index, const uint8_t *id, const uint8_t *block);
+
+/** Maps a fragment file. The header and the stripe index are always
+ * checked, the strips only with RAIN_FRAGMENT_VERIFY.
+ *
+ * @return NULL on error (errno is set, EBADMSG for a checksum mismatch)
+ */
+struct rain_fragment_s* rain_fragment_open (const char *path, int flags);
+
+/** Same as rain_fragment_open() on a fragment already in memory. The
+ * buffer is not copied and must outlive the fragment. */
+struct rain_fragment_s* rain_fragment_open_buffer (const uint8_t *buf,
+		size_t len, int flags);
+
+void rain_fragment_close (struct rain_fragment_s *fragment);
+
+/** @return the encoding of the object the fragment belongs to */
+const struct rain_encoding_s* rain_fragment_encoding (
+		const struct rain_fragment_s *fragment);
+
+/** @return the index of the block held, 0 to k+m-1 */
+unsigned int rain_fragment_index (const struct rain_fragment_s *fragment);
+
+/** @return the RAIN_FRAGMENT_ID bytes of the object id */
+const uint8_t* rain_fragment_id (const struct rain_fragment_s *fragment);
+
+/** @return the block held, in place, block_size bytes */
+const uint8_t* rain_fragment_block (const struct rain_fragment_s *fragment);
+
+/** @return the number of stripes of the block */
+unsigned int rain_fragment_stripes (const struct rain_fragment_s *fragment);
+
+/** Checks the strip of the block in the given stripe.
+ * @return a boolean value, false if it is corrupted (errno is set) */
+int rain_fragment_verify_stripe (const struct rain_fragment_s *fragment,
+		unsigned int stripe);
+
+/** Sorts fragments of the same object by index, without any copy.
+ *
+ * @param fragments an array of 'count' fragments, in any order
+ * @param enc filled with the encoding of the object
+ * @param data must have at least k slots, NULL where the block is missing
+ * @param parity must have at least m slots, NULL where the block is missing
+ * @return a boolean value, false if the fragments do not belong to the
+ *   same object or have the same index (errno is set)
+ */
+int rain_fragment_blocks (struct rain_fragment_s **fragments,
+		unsigned int count, struct rain_encoding_s *enc,
+		uint8_t **data, uint8_t **parity);
+
+/** Rebuilds the original object from at least k of its fragments, and
+ * writes it (without padding) into the given segments.
+ *
+ * @param env can be NULL
+ * @param iov at least data_size bytes, cf. rain_fragment_encoding()
+ * @return a boolean value, false if it failed (errno is set)
+ */
+int rain_fragment_rehydrate (struct rain_fragment_s **fragments,
+		unsigned int count, struct rain_env_s *env,
+		const struct iovec *iov, int iovcnt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBRAIN_rain_fragment_h
@@ -0,0 +1,59 @@
+#ifndef LIBRAIN_rain_io_h
+#define LIBRAIN_rain_io_h 1
+
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* Internal helpers of the on-disk formats: integers are stored in little
+ * endian whatever the host, and files are written in full. */
+
+static inline void
+_put32(uint8_t *p, uint32_t v)
+{
+	for (int i = 0; i < 4; ++i, v >>= 8)
+		p[i] = v & 0xFF;
+}
+
+static inline void
+_put64(uint8_t *p, uint64_t v)
+{
+	for (int i = 0; i < 8; ++i, v >>= 8)
+		p[i] = v & 0xFF;
+}
+
+static inline uint32_t
+_get32(const uint8_t *p)
+{
+	uint32_t v = 0;
+	for (int i = 3; i >= 0; --i)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static inline uint64_t
+_get64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; --i)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+/* Retries the short and interrupted writes, 0 on error (errno is set) */
+static inline int
+_write_full(int fd, const uint8_t *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t w = write(fd, buf, len);
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w <= 0)
+			return 0;
+		buf += w;
+		len -= w;
+	}
+	return 1;
+}
+
+#endif // LIBRAIN_rain_io_h
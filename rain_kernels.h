@@ -0,0 +1,39 @@
+#ifndef LIBRAIN_rain_kernels_h
+#define LIBRAIN_rain_kernels_h 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "librain.h"
+
+/* Straight-line XOR kernels, generated at build time by rain_kernels_gen
+ * for the profiles listed in RAIN_KERNELS. Each one computes the targets
+ * of a decoding plan built with the default sources (the first k blocks
+ * not rebuilt), thus the encoding itself is the plan whose targets are
+ * all the parity blocks. */
+
+/** Vectors are loaded and stored with no alignment constraint, but the
+ * packet size must be a multiple of their width */
+#define RAIN_KERNEL_VECTOR 16
+
+/**
+ * @param src the k source blocks
+ * @param dst the target blocks
+ * @param size the size of each block, a multiple of w * packet_size
+ * @param packet_size a multiple of RAIN_KERNEL_VECTOR
+ */
+typedef void (*rain_kernel_f) (uint8_t **src, uint8_t **dst,
+		size_t size, size_t packet_size);
+
+struct rain_kernel_s
+{
+	enum rain_algorithm_e algo;
+	unsigned int k, m, w;
+	uint64_t targets; /**< Bitmask of the blocks rebuilt */
+	rain_kernel_f run;
+};
+
+/** Terminated by an entry whose algo is JALG_unset */
+extern const struct rain_kernel_s rain_kernels[];
+
+#endif // LIBRAIN_rain_kernels_h
@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jerasure/jerasure.h>
+
+#include "librain.h"
+#include "rain_kernels.h"
+
+/* Emits the C source of the straight-line kernels of the profiles given
+ * as "algo:k:m" arguments: one for the encoding, one per single erasure.
+ * Each kernel is the unrolled translation of the smart schedule of the
+ * decoding plan, each packet being processed as a vector register. */
+
+static const char *
+_algo_to_enum (enum rain_algorithm_e algo)
+{
+	switch (algo) {
+		case JALG_liberation: return "JALG_liberation";
+		case JALG_crs: return "JALG_crs";
+		case JALG_crs_min: return "JALG_crs_min";
+		default: return NULL;
+	}
+}
+
+static void
+_emit_kernel (FILE *out, const char *name, struct rain_encoding_s *enc,
+		struct rain_decode_plan_s *plan)
+{
+	const unsigned int k = enc->k, w = enc->w;
+	unsigned int nb_targets = 0;
+	for (const int *t = rain_decode_plan_targets(plan); *t >= 0; ++t)
+		nb_targets ++;
+
+	int **schedule = jerasure_smart_bitmatrix_to_schedule(k, nb_targets, w,
+			(int*) rain_decode_plan_bitmatrix(plan));
+	int loaded[k * w];
+	memset (loaded, 0, sizeof(loaded));
+
+	fprintf (out, "static void\n%s (uint8_t **src, uint8_t **dst,\n"
+			"\t\tsize_t size, size_t ps)\n{\n", name);
+	fprintf (out, "\tfor (size_t off = 0; off < size; off += %u * ps) {\n", w);
+	fprintf (out, "\t\tfor (size_t v = 0; v < ps; v += RAIN_KERNEL_VECTOR) {\n");
+	fprintf (out, "\t\t\tconst size_t o = off + v;\n");
+	for (unsigned int t = 0; t < nb_targets; ++t) {
+		for (unsigned int x = 0; x < w; ++x)
+			fprintf (out, "\t\t\train_v d%u_%u = {0};\n", t, x);
+	}
+	for (int **op = schedule; (*op)[0] >= 0; ++op) {
+		const int sdev = (*op)[0], spkt = (*op)[1];
+		const int ddev = (*op)[2] - k, dpkt = (*op)[3];
+		char operand[32];
+		if ((unsigned int)sdev < k) {
+			if (!loaded[sdev * w + spkt]) {
+				fprintf (out, "\t\t\tconst rain_v s%d_%d = _load (src[%d] + o + %d * ps);\n",
+						sdev, spkt, sdev, spkt);
+				loaded[sdev * w + spkt] = 1;
+			}
+			snprintf (operand, sizeof(operand), "s%d_%d", sdev, spkt);
+		} else {
+			snprintf (operand, sizeof(operand), "d%d_%d", sdev - k, spkt);
+		}
+		fprintf (out, "\t\t\td%d_%d %s %s;\n", ddev, dpkt,
+				(*op)[4] ? "^=" : "=", operand);
+	}
+	for (unsigned int t = 0; t < nb_targets; ++t) {
+		for (unsigned int x = 0; x < w; ++x)
+			fprintf (out, "\t\t\t_store (dst[%u] + o + %u * ps, d%u_%u);\n",
+					t, x, t, x);
+	}
+	fprintf (out, "\t\t}\n\t}\n}\n\n");
+
+	jerasure_free_schedule(schedule);
+}
+
+static int
+_emit_profile (FILE *out, FILE *table, const char *profile)
+{
+	char algo[32];
+	unsigned int k = 0, m = 0;
+	if (sscanf (profile, "%31[^:]:%u:%u", algo, &k, &m) != 3) {
+		fprintf (stderr, "Invalid profile [%s], expected algo:k:m\n", profile);
+		return 0;
+	}
+
+	struct rain_encoding_s enc;
+	if (!rain_get_encoding (&enc, 0, k, m, algo) || !_algo_to_enum(enc.algo)
+			|| k + m > 64) {
+		fprintf (stderr, "Unsupported profile [%s]\n", profile);
+		return 0;
+	}
+
+	const unsigned int sum = k + m;
+	for (unsigned int e = 0; e <= sum; ++e) {
+		// The encoding first, then each single erasure
+		int targets[m + 1];
+		uint64_t mask = 0;
+		if (e == 0) {
+			for (unsigned int i = 0; i < m; ++i)
+				targets[i] = k + i;
+			targets[m] = -1;
+		} else {
+			targets[0] = e - 1;
+			targets[1] = -1;
+		}
+		for (int *t = targets; *t >= 0; ++t)
+			mask |= ((uint64_t)1) << *t;
+
+		struct rain_decode_plan_s *plan = rain_decode_plan_create_ext(&enc,
+				targets, NULL);
+		if (!plan) {
+			fprintf (stderr, "Plan error on [%s]: %s\n", profile, strerror(errno));
+			return 0;
+		}
+
+		char name[128];
+		snprintf (name, sizeof(name), "_kernel_%s_%u_%u_%llx", algo, k, m,
+				(unsigned long long) mask);
+		_emit_kernel (out, name, &enc, plan);
+		fprintf (table, "\t{ %s, %u, %u, %u, 0x%llxULL, %s },\n",
+				_algo_to_enum(enc.algo), k, m, enc.w,
+				(unsigned long long) mask, name);
+		rain_decode_plan_free (plan);
+	}
+	return 1;
+}
+
+int
+main (int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf (stderr, "Usage: %s OUTPUT [algo:k:m]...\n", argv[0]);
+		return 1;
+	}
+
+	FILE *out = fopen (argv[1], "w");
+	FILE *table = tmpfile ();
+	if (!out || !table) {
+		fprintf (stderr, "Cannot open [%s]: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+
+	fprintf (out, "/* Generated by rain_kernels_gen, do not edit. */\n\n");
+	fprintf (out, "#include <stdint.h>\n#include <stddef.h>\n\n");
+	fprintf (out, "#include \"librain.h\"\n#include \"rain_kernels.h\"\n\n");
+	fprintf (out, "typedef uint64_t rain_v __attribute__ ((vector_size (RAIN_KERNEL_VECTOR)));\n\n");
+	fprintf (out, "static inline rain_v\n_load (const uint8_t *p)\n{\n"
+			"\train_v v;\n\t__builtin_memcpy (&v, p, sizeof(v));\n\treturn v;\n}\n\n");
+	fprintf (out, "static inline void\n_store (uint8_t *p, rain_v v)\n{\n"
+			"\t__builtin_memcpy (p, &v, sizeof(v));\n}\n\n");
+
+	int rc = 0;
+	for (int i = 2; i < argc && !rc; ++i) {
+		if (!_emit_profile (out, table, argv[i]))
+			rc = 1;
+	}
+
+	fprintf (out, "const struct rain_kernel_s rain_kernels[] =\n{\n");
+	rewind (table);
+	char line[256];
+	while (fgets (line, sizeof(line), table))
+		fputs (line, out);
+	fprintf (out, "\t{ JALG_unset, 0, 0, 0, 0, NULL }\n};\n");
+
+	fclose (table);
+	if (fclose (out) != 0)
+		rc = 1;
+	if (rc)
+		remove (argv[1]);
+	return rc;
+}
@@ -0,0 +1,429 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+
+#include "librain.h"
+#include "rain_pack.h"
+#include "utils.h"
+#include "rain_io.h"
+
+static struct rain_env_s env_DEFAULT = { malloc, calloc, free };
+
+static const char pack_MAGIC[8] = { 'R','A','I','N','P','A','C','K' };
+
+/* The packed data starts with its index, in little endian: the magic, the
+ * version, the number of objects, then an entry {id, offset, length} per
+ * object, sorted by id. The offsets are in the packed data. */
+#define OFF_MAGIC 0
+#define OFF_VERSION 8
+#define OFF_COUNT 12
+
+struct object_s
+{
+	uint64_t id;
+	size_t offset; /**< In the buffer of the pack */
+	size_t len;
+};
+
+struct rain_pack_s
+{
+	struct rain_env_s *env;
+	const char *algo;
+	unsigned int k, m;
+	int flags;
+	size_t capacity;
+
+	uint8_t *buf; /**< The objects, one after the other */
+	size_t used, allocated;
+	struct object_s *objects; /**< Sorted by id */
+	unsigned int count, max;
+};
+
+struct rain_pack_s *
+rain_pack_create(const char *algo, unsigned int k, unsigned int m, int flags,
+		size_t capacity, struct rain_env_s *env)
+{
+	assert(algo != NULL);
+
+	struct rain_encoding_s enc;
+	if (!k || !m || capacity < RAIN_PACK_HEADER
+			|| !rain_get_encoding_ext(&enc, 0, k, m, algo, flags)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!env)
+		env = &env_DEFAULT;
+	struct rain_pack_s *pack = env->calloc(1, sizeof(*pack));
+	if (!pack) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	pack->env = env;
+	pack->algo = rain_algorithm_name(enc.algo);
+	pack->k = k;
+	pack->m = m;
+	pack->flags = flags;
+	pack->capacity = capacity;
+	return pack;
+}
+
+void
+rain_pack_destroy(struct rain_pack_s *pack)
+{
+	if (!pack)
+		return;
+	if (pack->buf)
+		pack->env->free(pack->buf);
+	if (pack->objects)
+		pack->env->free(pack->objects);
+	pack->env->free(pack);
+}
+
+unsigned int
+rain_pack_count(const struct rain_pack_s *pack)
+{
+	assert(pack != NULL);
+	return pack->count;
+}
+
+size_t
+rain_pack_size(const struct rain_pack_s *pack)
+{
+	assert(pack != NULL);
+	return RAIN_PACK_HEADER + pack->count * RAIN_PACK_ENTRY + pack->used;
+}
+
+/* The env has no realloc() */
+static void *
+_grow(struct rain_env_s *env, void *old, size_t old_size, size_t size)
+{
+	void *p = env->malloc(size);
+	if (!p)
+		return NULL;
+	if (old) {
+		memcpy(p, old, old_size);
+		env->free(old);
+	}
+	return p;
+}
+
+int
+rain_pack_add(struct rain_pack_s *pack, uint64_t id, const uint8_t *obj,
+		size_t len)
+{
+	assert(pack != NULL);
+	assert(obj != NULL || len == 0);
+
+	if (len + RAIN_PACK_ENTRY > pack->capacity - rain_pack_size(pack)) {
+		errno = ENOSPC;
+		return 0;
+	}
+	// The objects are kept sorted by id, the place of the new one is found
+	// by a binary search
+	unsigned int lo = 0, hi = pack->count;
+	while (lo < hi) {
+		const unsigned int mid = lo + (hi - lo) / 2;
+		if (pack->objects[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < pack->count && pack->objects[lo].id == id) {
+		errno = EEXIST;
+		return 0;
+	}
+
+	if (pack->count >= pack->max) {
+		unsigned int max = MACRO_COND(pack->max > 0, pack->max * 2, 64);
+		struct object_s *p = _grow(pack->env, pack->objects,
+				pack->count * sizeof(struct object_s),
+				max * sizeof(struct object_s));
+		if (!p) {
+			errno = ENOMEM;
+			return 0;
+		}
+		pack->objects = p;
+		pack->max = max;
+	}
+	if (pack->used + len > pack->allocated) {
+		size_t size = MACRO_COND(pack->allocated > 0, pack->allocated, 65536);
+		while (pack->used + len > size)
+			size *= 2;
+		size = MACRO_COND(size > pack->capacity, pack->capacity, size);
+		uint8_t *p = _grow(pack->env, pack->buf, pack->used, size);
+		if (!p) {
+			errno = ENOMEM;
+			return 0;
+		}
+		pack->buf = p;
+		pack->allocated = size;
+	}
+
+	struct object_s *o = pack->objects + lo;
+	if (lo < pack->count)
+		memmove(o + 1, o, (pack->count - lo) * sizeof(struct object_s));
+	pack->count ++;
+	o->id = id;
+	o->offset = pack->used;
+	o->len = len;
+	if (len > 0)
+		memcpy(pack->buf + pack->used, obj, len);
+	pack->used += len;
+	return 1;
+}
+
+int
+rain_pack_seal(struct rain_pack_s *pack, struct rain_encoding_s *enc,
+		uint8_t **data, uint8_t **parity)
+{
+	assert(pack != NULL);
+	assert(enc != NULL);
+	assert(data != NULL);
+	assert(parity != NULL);
+
+	const size_t index = RAIN_PACK_HEADER + pack->count * RAIN_PACK_ENTRY;
+	const size_t total = index + pack->used;
+	if (!rain_get_encoding_ext(enc, total, pack->k, pack->m, pack->algo,
+				pack->flags)) {
+		errno = EINVAL;
+		return 0;
+	}
+	uint8_t *packed = pack->env->malloc(enc->padded_data_size);
+	if (!packed) {
+		errno = ENOMEM;
+		return 0;
+	}
+
+	memcpy(packed + OFF_MAGIC, pack_MAGIC, sizeof(pack_MAGIC));
+	_put32(packed + OFF_VERSION, RAIN_PACK_VERSION);
+	_put32(packed + OFF_COUNT, pack->count);
+	for (unsigned int i = 0; i < pack->count; ++i) {
+		uint8_t *entry = packed + RAIN_PACK_HEADER + (i * RAIN_PACK_ENTRY);
+		_put64(entry, pack->objects[i].id);
+		_put64(entry + 8, index + pack->objects[i].offset);
+		_put64(entry + 16, pack->objects[i].len);
+	}
+	if (pack->used > 0)
+		memcpy(packed + index, pack->buf, pack->used);
+	memset(packed + total, 0, enc->padded_data_size - total);
+
+	// The packed data is already padded, its blocks are encoded in place
+	uint8_t *blocks[enc->k];
+	for (unsigned int i = 0; i < enc->k; ++i)
+		blocks[i] = packed + (i * enc->block_size);
+	unsigned int allocated = 0;
+	for (; allocated < enc->m; ++allocated) {
+		if (!(parity[allocated] = pack->env->malloc(enc->block_size)))
+			break;
+	}
+	if (allocated < enc->m)
+		errno = ENOMEM;
+	if (allocated < enc->m || !rain_encode_noalloc(enc, blocks, parity)) {
+		const int errsave = errno;
+		for (unsigned int i = 0; i < allocated; ++i) {
+			pack->env->free(parity[i]);
+			parity[i] = NULL;
+		}
+		pack->env->free(packed);
+		errno = errsave;
+		return 0;
+	}
+	*data = packed;
+	pack->count = 0;
+	pack->used = 0;
+	return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct reader_s
+{
+	struct rain_encoding_s *enc;
+	uint8_t **blocks;
+	struct rain_env_s *env;
+	struct rain_decode_plan_s *plan; /**< Rebuilds the missing data blocks */
+};
+
+/* Rebuilds [from,to[ of the missing block 'index', from the range of
+ * whole stripes starting at 'start' */
+static int
+_rebuild_range(struct reader_s *r, unsigned int index, size_t start,
+		size_t len, size_t tail_packet_size, size_t from, size_t to,
+		uint8_t *dst)
+{
+	struct rain_encoding_s *enc = r->enc;
+	const unsigned int k = enc->k;
+
+	// The missing data blocks, from the first k blocks available
+	if (!r->plan) {
+		int targets[k + 1], sources[k + 1];
+		unsigned int nb_targets = 0, nb_sources = 0;
+		for (unsigned int i = 0; i < k + enc->m; ++i) {
+			if (!r->blocks[i] && i < k)
+				targets[nb_targets++] = i;
+			else if (r->blocks[i] && nb_sources < k)
+				sources[nb_sources++] = i;
+		}
+		targets[nb_targets] = sources[nb_sources] = -1;
+		if (nb_sources < k) {
+			errno = EINVAL;
+			return 0;
+		}
+		if (!(r->plan = rain_decode_plan_create_ext(enc, targets, sources)))
+			return 0;
+	}
+
+	// The range as an encoding of its own, cf. rain_stream.c
+	struct rain_encoding_s sub = *enc;
+	sub.block_size = len;
+	sub.tail_packet_size = tail_packet_size;
+
+	unsigned int nb_targets = 0;
+	for (const int *t = rain_decode_plan_targets(r->plan); *t >= 0; ++t)
+		nb_targets ++;
+	uint8_t *buf = r->env->malloc(nb_targets * len);
+	if (!buf) {
+		errno = ENOMEM;
+		return 0;
+	}
+
+	uint8_t *data[k], *parity[enc->m];
+	memset(data, 0, sizeof(data));
+	memset(parity, 0, sizeof(parity));
+	for (const int *s = rain_decode_plan_sources(r->plan); *s >= 0; ++s) {
+		if ((unsigned int)*s < k)
+			data[*s] = r->blocks[*s] + start;
+		else
+			parity[*s - k] = r->blocks[*s] + start;
+	}
+	uint8_t *b = buf;
+	for (const int *t = rain_decode_plan_targets(r->plan); *t >= 0; ++t, b += len) {
+		if ((unsigned int)*t < k)
+			data[*t] = b;
+		else
+			parity[*t - k] = b;
+	}
+
+	int rc = rain_decode_plan_apply(r->plan, &sub, data, parity);
+	if (rc)
+		memcpy(dst, data[index] + (from - start), to - from);
+	r->env->free(buf);
+	return rc;
+}
+
+/* Reads [offset,offset+len[ of the packed data */
+static int
+_read(struct reader_s *r, size_t offset, size_t len, uint8_t *dst)
+{
+	const struct rain_encoding_s *enc = r->enc;
+	const size_t bs = enc->block_size;
+	const size_t tail = enc->w * enc->tail_packet_size;
+	const size_t head = bs - tail;
+
+	for (size_t end = offset + len; offset < end; ) {
+		const unsigned int index = offset / bs;
+		const size_t from = offset - (index * bs);
+		const size_t to = MACRO_COND(end - (index * bs) < bs,
+				end - (index * bs), bs);
+		if (r->blocks[index]) {
+			memcpy(dst, r->blocks[index] + from, to - from);
+		} else {
+			// Only the stripes holding the range
+			if (from < head) {
+				size_t hto = MACRO_COND(to < head, to, head);
+				size_t start = _lower_multiple(from, enc->strip_size);
+				size_t stop = _upper_multiple(hto, enc->strip_size);
+				if (!_rebuild_range(r, index, start, stop - start, 0,
+							from, hto, dst))
+					return 0;
+			}
+			if (to > head) {
+				size_t tfrom = MACRO_COND(from > head, from, head);
+				if (!_rebuild_range(r, index, head, tail,
+							enc->tail_packet_size, tfrom, to,
+							dst + (tfrom - from)))
+					return 0;
+			}
+		}
+		dst += to - from;
+		offset += to - from;
+	}
+	return 1;
+}
+
+static int
+_extract(struct reader_s *r, uint64_t id, uint8_t **out, size_t *len)
+{
+	const struct rain_encoding_s *enc = r->enc;
+	uint8_t header[RAIN_PACK_HEADER];
+	if (enc->data_size < RAIN_PACK_HEADER) {
+		errno = EINVAL;
+		return 0;
+	}
+	if (!_read(r, 0, RAIN_PACK_HEADER, header))
+		return 0;
+	const uint32_t count = _get32(header + OFF_COUNT);
+	if (memcmp(header + OFF_MAGIC, pack_MAGIC, sizeof(pack_MAGIC))
+			|| _get32(header + OFF_VERSION) != RAIN_PACK_VERSION
+			|| (enc->data_size - RAIN_PACK_HEADER) / RAIN_PACK_ENTRY < count) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	// The index is searched in place, only its entries are read
+	uint8_t entry[RAIN_PACK_ENTRY];
+	uint32_t lo = 0, hi = count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (!_read(r, RAIN_PACK_HEADER + (size_t)mid * RAIN_PACK_ENTRY,
+					RAIN_PACK_ENTRY, entry))
+			return 0;
+		uint64_t found = _get64(entry);
+		if (found == id) {
+			const uint64_t offset = _get64(entry + 8), size = _get64(entry + 16);
+			if (offset > enc->data_size || size > enc->data_size - offset) {
+				errno = EINVAL;
+				return 0;
+			}
+			*out = r->env->malloc(MACRO_COND(size > 0, size, 1));
+			if (!*out) {
+				errno = ENOMEM;
+				return 0;
+			}
+			if (!_read(r, offset, size, *out)) {
+				r->env->free(*out);
+				*out = NULL;
+				return 0;
+			}
+			*len = size;
+			return 1;
+		}
+		if (found < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	errno = ENOENT;
+	return 0;
+}
+
+int
+rain_pack_extract(struct rain_encoding_s *enc, uint8_t **blocks, uint64_t id,
+		struct rain_env_s *env, uint8_t **out, size_t *len)
+{
+	assert(enc != NULL);
+	assert(blocks != NULL);
+	assert(out != NULL);
+	assert(len != NULL);
+
+	struct reader_s r;
+	r.enc = enc;
+	r.blocks = blocks;
+	r.env = env ? env : &env_DEFAULT;
+	r.plan = NULL;
+	int rc = _extract(&r, id, out, len);
+	if (r.plan)
+		rain_decode_plan_free(r.plan);
+	return rc;
+}
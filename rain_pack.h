@@ -0,0 +1,81 @@
+#ifndef LIBRAIN_rain_pack_h
+#define LIBRAIN_rain_pack_h 1
+
+#include <stdint.h>
+#include "librain.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Packing of small objects: encoded alone, an object of a few KiB is
+ * padded to k strips at least, and costs a whole encoding. Many of them
+ * are rather gathered in one packed object, encoded once, whose data
+ * starts with an index giving the place of each object by its id. Any
+ * object can then be read back alone, even with blocks missing. */
+
+#define RAIN_PACK_VERSION 1
+
+/** Size of the index of the packed data, then 24 bytes per object */
+#define RAIN_PACK_HEADER 16
+#define RAIN_PACK_ENTRY 24
+
+/** Accumulates objects until it is sealed, not thread-safe */
+struct rain_pack_s;
+
+/** @param capacity the maximum size of the packed data, index included
+ * @param env can be NULL
+ * @return NULL on error (errno is set, EINVAL for an invalid profile)
+ */
+struct rain_pack_s* rain_pack_create (const char *algo, unsigned int k,
+		unsigned int m, int flags, size_t capacity, struct rain_env_s *env);
+
+void rain_pack_destroy (struct rain_pack_s *pack);
+
+/** Copies the object into the pack.
+ * @return a boolean value, false if it failed (errno is set, ENOSPC if the
+ *   pack is too full for it, EEXIST if the id is already in the pack)
+ */
+int rain_pack_add (struct rain_pack_s *pack, uint64_t id,
+		const uint8_t *obj, size_t len);
+
+/** @return the number of objects added since the pack was last sealed */
+unsigned int rain_pack_count (const struct rain_pack_s *pack);
+
+/** @return the size of the packed data if it was sealed now */
+size_t rain_pack_size (const struct rain_pack_s *pack);
+
+/** Encodes the objects added so far, and empties the pack for the next
+ * ones.
+ *
+ * @param enc filled with the encoding of the packed data
+ * @param data set to the k data blocks, contiguous, allocated with the
+ *   env of the pack
+ * @param parity must have at least m slots, set to the parity blocks
+ *   allocated with the env of the pack
+ * @return a boolean value, false if it failed (errno is set, and the pack
+ *   is left untouched)
+ */
+int rain_pack_seal (struct rain_pack_s *pack, struct rain_encoding_s *enc,
+		uint8_t **data, uint8_t **parity);
+
+/** Reads one object of a sealed pack. Only the ranges of the blocks
+ * holding the index and the object are read, those of the missing data
+ * blocks are rebuilt stripe by stripe.
+ *
+ * @param blocks the k+m blocks of the pack, NULL for the missing ones
+ * @param env can be NULL
+ * @param out set to the object, allocated with 'env'
+ * @param len set to the size of the object
+ * @return a boolean value, false if it failed (errno is set, ENOENT if
+ *   the object is not in the pack, EINVAL if too many blocks are missing
+ *   or the index is invalid)
+ */
+int rain_pack_extract (struct rain_encoding_s *enc, uint8_t **blocks,
+		uint64_t id, struct rain_env_s *env, uint8_t **out, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBRAIN_rain_pack_h
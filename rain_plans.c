@@ -0,0 +1,405 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "librain.h"
+#include "rain_fragment.h"
+#include "rain_plans.h"
+#include "utils.h"
+#include "rain_io.h"
+
+static const char plans_MAGIC[8] = { 'R','A','I','N','P','L','A','N' };
+
+#define PLANS_BYTE_ORDER 0x01020304
+
+/* The file is a header, the index sorted by key, then the plans as
+ * exported by rain_decode_plan_export(), each aligned on 8 bytes. The CRC
+ * of the header covers the header (with a zeroed CRC) and the index. */
+struct header_s
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t int_size;
+	uint32_t nb_entries;
+	uint64_t length; /**< Of the whole file */
+	uint32_t crc;
+	uint32_t reserved[7];
+};
+
+struct entry_s
+{
+	uint32_t algo, k, m, w;
+	uint64_t erasures; /**< A bit per erased block */
+	uint64_t offset; /**< Of the plan, in bytes from the start of the file */
+	uint64_t count; /**< Of ints in the plan */
+	uint32_t crc; /**< Of the plan */
+	uint32_t reserved;
+};
+
+struct rain_plans_s
+{
+	const uint8_t *base;
+	size_t length;
+	const struct entry_s *entries;
+	unsigned int nb_entries;
+};
+
+static int
+_cmp_entry(const void *p0, const void *p1)
+{
+	const struct entry_s *a = p0, *b = p1;
+	if (a->algo != b->algo)
+		return a->algo < b->algo ? -1 : 1;
+	if (a->k != b->k)
+		return a->k < b->k ? -1 : 1;
+	if (a->m != b->m)
+		return a->m < b->m ? -1 : 1;
+	if (a->w != b->w)
+		return a->w < b->w ? -1 : 1;
+	if (a->erasures != b->erasures)
+		return a->erasures < b->erasures ? -1 : 1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct builder_s
+{
+	struct entry_s *entries;
+	unsigned int nb_entries, max_entries;
+	int *plans; /**< All the exported plans, each padded to 8 bytes */
+	size_t nb_ints, max_ints;
+};
+
+static int
+_add_plan(struct builder_s *b, struct rain_encoding_s *enc, uint64_t mask)
+{
+	int erasures[65];
+	unsigned int nb = 0;
+	for (unsigned int i = 0; i < enc->k + enc->m; ++i) {
+		if (mask & (((uint64_t)1) << i))
+			erasures[nb++] = i;
+	}
+	erasures[nb] = -1;
+
+	struct rain_decode_plan_s *plan = rain_decode_plan_create(enc, erasures);
+	if (!plan)
+		return 0;
+	size_t count = rain_decode_plan_export(plan, NULL);
+	size_t padded = _upper_multiple(count, 2);
+	if (b->nb_ints + padded > b->max_ints) {
+		size_t max = MACRO_COND(b->max_ints > 0, b->max_ints * 2, 65536);
+		while (b->nb_ints + padded > max)
+			max *= 2;
+		int *p = realloc(b->plans, max * sizeof(int));
+		if (!p) {
+			rain_decode_plan_free(plan);
+			errno = ENOMEM;
+			return 0;
+		}
+		b->plans = p;
+		b->max_ints = max;
+	}
+	if (b->nb_entries >= b->max_entries) {
+		unsigned int max = MACRO_COND(b->max_entries > 0, b->max_entries * 2, 256);
+		struct entry_s *p = realloc(b->entries, max * sizeof(struct entry_s));
+		if (!p) {
+			rain_decode_plan_free(plan);
+			errno = ENOMEM;
+			return 0;
+		}
+		b->entries = p;
+		b->max_entries = max;
+	}
+
+	int *out = b->plans + b->nb_ints;
+	rain_decode_plan_export(plan, out);
+	rain_decode_plan_free(plan);
+	memset(out + count, 0, (padded - count) * sizeof(int));
+
+	struct entry_s *e = b->entries + (b->nb_entries++);
+	memset(e, 0, sizeof(*e));
+	e->algo = enc->algo;
+	e->k = enc->k;
+	e->m = enc->m;
+	e->w = enc->w;
+	e->erasures = mask;
+	e->offset = b->nb_ints * sizeof(int); // relative to the plans, for now
+	e->count = count;
+	e->crc = rain_crc32c(0, (uint8_t*) out, count * sizeof(int));
+	b->nb_ints += padded;
+	return 1;
+}
+
+static int
+_add_profile(struct builder_s *b, const struct rain_profile_s *profile)
+{
+	struct rain_encoding_s enc;
+	if (!profile->algo || !profile->k || !profile->m
+			|| profile->k + profile->m > 64
+			|| !rain_get_encoding_ext(&enc, 0, profile->k, profile->m,
+				profile->algo, 0)) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	// The patterns of r erasures, in increasing order (Gosper's hack)
+	const unsigned int sum = enc.k + enc.m;
+	for (unsigned int r = 1; r <= enc.m; ++r) {
+		uint64_t mask = (((uint64_t)1) << r) - 1;
+		while (!(mask >> (sum - 1) >> 1)) {
+			if (!_add_plan(b, &enc, mask))
+				return 0;
+			uint64_t low = mask & -mask, ripple = mask + low;
+			if (!ripple)
+				break;
+			mask = (((ripple ^ mask) >> 2) / low) | ripple;
+		}
+	}
+	return 1;
+}
+
+static int
+_write_store(int fd, struct builder_s *b)
+{
+	struct header_s h;
+	const size_t index = b->nb_entries * sizeof(struct entry_s);
+	const size_t start = _upper_multiple(sizeof(h) + index, 8);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, plans_MAGIC, sizeof(plans_MAGIC));
+	h.version = RAIN_PLANS_VERSION;
+	h.byte_order = PLANS_BYTE_ORDER;
+	h.int_size = sizeof(int);
+	h.nb_entries = b->nb_entries;
+	h.length = start + b->nb_ints * sizeof(int);
+	for (unsigned int i = 0; i < b->nb_entries; ++i)
+		b->entries[i].offset += start;
+	h.crc = rain_crc32c(0, (uint8_t*) &h, sizeof(h));
+	h.crc = rain_crc32c(h.crc, (uint8_t*) b->entries, index);
+
+	uint8_t pad[8] = {0};
+	return _write_full(fd, (uint8_t*) &h, sizeof(h))
+		&& _write_full(fd, (uint8_t*) b->entries, index)
+		&& _write_full(fd, pad, start - sizeof(h) - index)
+		&& _write_full(fd, (uint8_t*) b->plans, b->nb_ints * sizeof(int));
+}
+
+int
+rain_plans_save(const char *path, const struct rain_profile_s *profiles,
+		unsigned int count)
+{
+	assert(path != NULL);
+	assert(profiles != NULL || count == 0);
+
+	struct builder_s b;
+	memset(&b, 0, sizeof(b));
+	int rc = 1;
+	for (unsigned int i = 0; rc && i < count; ++i)
+		rc = _add_profile(&b, profiles + i);
+
+	// Sorted for the lookups, the plans stay where they are
+	if (rc && b.nb_entries > 0) {
+		qsort(b.entries, b.nb_entries, sizeof(struct entry_s), _cmp_entry);
+		for (unsigned int i = 1; rc && i < b.nb_entries; ++i) {
+			if (!_cmp_entry(b.entries + i - 1, b.entries + i)) {
+				errno = EINVAL;
+				rc = 0;
+			}
+		}
+	}
+
+	// Written aside then renamed, the processes mapping it are not disturbed
+	char tmp[strlen(path) + 8];
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	int fd = rc ? mkstemp(tmp) : -1;
+	if (fd < 0) {
+		rc = 0;
+	} else {
+		rc = _write_store(fd, &b) && fsync(fd) == 0;
+		if (close(fd) < 0)
+			rc = 0;
+		if (rc && rename(tmp, path) < 0)
+			rc = 0;
+		if (!rc) {
+			int errsave = errno;
+			unlink(tmp);
+			errno = errsave;
+		}
+	}
+
+	if (b.entries)
+		free(b.entries);
+	if (b.plans)
+		free(b.plans);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int
+_check(const uint8_t *base, size_t length)
+{
+	struct header_s h;
+	if (length < sizeof(h)) {
+		errno = EINVAL;
+		return 0;
+	}
+	memcpy(&h, base, sizeof(h));
+	if (memcmp(h.magic, plans_MAGIC, sizeof(plans_MAGIC))
+			|| h.version != RAIN_PLANS_VERSION
+			|| h.byte_order != PLANS_BYTE_ORDER
+			|| h.int_size != sizeof(int)) {
+		errno = EINVAL;
+		return 0;
+	}
+	const size_t index = (size_t)h.nb_entries * sizeof(struct entry_s);
+	if (h.length != length || (length - sizeof(h)) / sizeof(struct entry_s)
+			< h.nb_entries) {
+		errno = EBADMSG;
+		return 0;
+	}
+
+	uint32_t crc = h.crc;
+	h.crc = 0;
+	uint32_t expected = rain_crc32c(0, (uint8_t*) &h, sizeof(h));
+	expected = rain_crc32c(expected, base + sizeof(h), index);
+	if (crc != expected) {
+		errno = EBADMSG;
+		return 0;
+	}
+
+	// The plans stay within the file, the lookups rely on the order
+	const struct entry_s *entries = (const struct entry_s*) (base + sizeof(h));
+	for (unsigned int i = 0; i < h.nb_entries; ++i) {
+		const struct entry_s *e = entries + i;
+		if (e->offset % 8 || e->offset > length
+				|| e->count > (length - e->offset) / sizeof(int)
+				|| (i > 0 && _cmp_entry(e - 1, e) >= 0)) {
+			errno = EBADMSG;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+struct rain_plans_s *
+rain_plans_open(const char *path)
+{
+	assert(path != NULL);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int errsave = errno;
+		close(fd);
+		errno = errsave;
+		return NULL;
+	}
+	if ((size_t)st.st_size < sizeof(struct header_s)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	struct rain_plans_s *plans = NULL;
+	if (_check(base, st.st_size)) {
+		plans = calloc(1, sizeof(*plans));
+		if (!plans)
+			errno = ENOMEM;
+	}
+	if (!plans) {
+		int errsave = errno;
+		munmap(base, st.st_size);
+		errno = errsave;
+		return NULL;
+	}
+	plans->base = base;
+	plans->length = st.st_size;
+	plans->entries = (const struct entry_s*) (plans->base
+			+ sizeof(struct header_s));
+	plans->nb_entries = ((const struct header_s*) base)->nb_entries;
+	return plans;
+}
+
+void
+rain_plans_close(struct rain_plans_s *plans)
+{
+	if (!plans)
+		return;
+	munmap((void*) plans->base, plans->length);
+	free(plans);
+}
+
+unsigned int
+rain_plans_count(const struct rain_plans_s *plans)
+{
+	assert(plans != NULL);
+	return plans->nb_entries;
+}
+
+struct rain_decode_plan_s *
+rain_plans_lookup(struct rain_plans_s *plans, struct rain_encoding_s *enc,
+		const int *erasures)
+{
+	assert(plans != NULL);
+	assert(enc != NULL);
+	assert(erasures != NULL);
+
+	struct entry_s key;
+	memset(&key, 0, sizeof(key));
+	key.algo = enc->algo;
+	key.k = enc->k;
+	key.m = enc->m;
+	key.w = enc->w;
+	for (; *erasures >= 0; ++erasures) {
+		if ((unsigned int)*erasures >= enc->k + enc->m || *erasures >= 64
+				|| (key.erasures & (((uint64_t)1) << *erasures))) {
+			errno = EINVAL;
+			return NULL;
+		}
+		key.erasures |= ((uint64_t)1) << *erasures;
+	}
+
+	const struct entry_s *e = bsearch(&key, plans->entries, plans->nb_entries,
+			sizeof(struct entry_s), _cmp_entry);
+	if (!e) {
+		errno = ENOENT;
+		return NULL;
+	}
+	const uint8_t *p = plans->base + e->offset;
+	if (rain_crc32c(0, p, e->count * sizeof(int)) != e->crc) {
+		errno = EBADMSG;
+		return NULL;
+	}
+	return rain_decode_plan_import(enc, (const int*) p, e->count);
+}
+
+struct rain_decode_plan_s *
+rain_plans_get(struct rain_plans_s *plans, struct rain_encoding_s *enc,
+		int *erasures)
+{
+	assert(enc != NULL);
+	assert(erasures != NULL);
+
+	if (plans) {
+		struct rain_decode_plan_s *plan = rain_plans_lookup(plans, enc,
+				erasures);
+		if (plan)
+			return plan;
+	}
+	return rain_decode_plan_create(enc, erasures);
+}
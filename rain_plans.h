@@ -0,0 +1,73 @@
+#ifndef LIBRAIN_rain_plans_h
+#define LIBRAIN_rain_plans_h 1
+
+#include <stdint.h>
+#include "librain.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Precomputed decoding plans: the plans of all the erasure patterns of a
+ * set of profiles are saved once in a file, that a process maps when it
+ * starts and uses in place instead of building them again. The file is
+ * specific to the byte order of the host that wrote it. */
+
+#define RAIN_PLANS_VERSION 1
+
+struct rain_profile_s
+{
+	const char *algo; /**< As for rain_get_encoding() */
+	unsigned int k, m;
+};
+
+/** A read-only store of plans, shared by any number of threads */
+struct rain_plans_s;
+
+/** Builds the plans of all the patterns of 1 to m erasures of each
+ * profile (rebuilding them from the first k intact blocks) and writes
+ * them to 'path', replaced atomically.
+ *
+ * @return a boolean value, false if it failed (errno is set)
+ */
+int rain_plans_save (const char *path, const struct rain_profile_s *profiles,
+		unsigned int count);
+
+/** Maps a file written by rain_plans_save(). The header and the index are
+ * checked now, each plan is checked when it is loaded.
+ *
+ * @return NULL on error (errno is set, EBADMSG if a checksum does not
+ *   match, EINVAL if the file is not a store for this host)
+ */
+struct rain_plans_s* rain_plans_open (const char *path);
+
+void rain_plans_close (struct rain_plans_s *plans);
+
+/** @return the number of plans in the store */
+unsigned int rain_plans_count (const struct rain_plans_s *plans);
+
+/** Loads the plan of rain_decode_plan_create() from the store. It refers
+ * to the mapped file: it must be freed before the store is closed.
+ *
+ * @param erasures indices of the missing blocks, and a final -1
+ * @return NULL on error (errno is set, ENOENT if the pattern is not in the
+ *   store, EBADMSG if the stored plan is corrupted), else a plan whose
+ *   targets are in increasing order.
+ */
+struct rain_decode_plan_s* rain_plans_lookup (struct rain_plans_s *plans,
+		struct rain_encoding_s *enc, const int *erasures);
+
+/** Loads the plan from the store when possible, else builds it with
+ * rain_decode_plan_create().
+ *
+ * @param plans can be NULL
+ * @return NULL on error (errno is set)
+ */
+struct rain_decode_plan_s* rain_plans_get (struct rain_plans_s *plans,
+		struct rain_encoding_s *enc, int *erasures);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBRAIN_rain_plans_h
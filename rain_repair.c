@@ -0,0 +1,620 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "librain.h"
+#include "rain_repair.h"
+#include "rain_plans.h"
+#include "utils.h"
+
+/* Erasure patterns are kept as bitmasks */
+#define REPAIR_MAX_BLOCKS 64
+
+static struct rain_env_s env_DEFAULT = { malloc, calloc, free };
+
+struct plan_key_s
+{
+	enum rain_algorithm_e algo;
+	unsigned int k, m, w;
+	uint64_t targets;
+	uint64_t excluded; /**< Blocks that failed to be fetched */
+};
+
+struct plan_slot_s
+{
+	struct plan_slot_s *next;
+	struct plan_key_s key;
+	struct rain_decode_plan_s *plan;
+	int loaded; /**< From the precomputed plans */
+};
+
+struct job_s
+{
+	struct rain_repair_job_s job;
+	struct plan_key_s key;
+	uint64_t seq;
+	unsigned int nb_targets;
+	int erasures[REPAIR_MAX_BLOCKS + 1];
+};
+
+/* A binary heap of jobs, the next to be served on top */
+struct queue_s
+{
+	pthread_mutex_t lock;
+	struct job_s **heap;
+	size_t len, alloc;
+};
+
+struct worker_s
+{
+	struct rain_repair_s *rs;
+	unsigned int id;
+	pthread_t thread;
+};
+
+struct rain_repair_s
+{
+	struct rain_repair_config_s cfg;
+	unsigned int nb_workers;
+	unsigned int nb_queues;
+	struct worker_s *workers;
+	struct queue_s *queues;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond_work; /**< jobs were queued or the pool stops */
+	pthread_cond_t cond_idle; /**< a job is over */
+	pthread_cond_t cond_memory; /**< block buffers were released */
+	uint64_t queued; /**< submitted and not started yet */
+	uint64_t pending; /**< submitted and not over yet */
+	uint64_t seq;
+	int stopping;
+	size_t memory_used;
+	double bandwidth_next; /**< when the next fetch may start */
+	double start;
+	struct plan_slot_s *plans;
+	struct rain_repair_stats_s stats;
+};
+
+static double
+_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+static void
+_sleep(double seconds)
+{
+	struct timespec ts;
+	ts.tv_sec = (time_t) seconds;
+	ts.tv_nsec = (long) ((seconds - (double)ts.tv_sec) * 1000000000.0);
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+}
+
+static uint64_t
+_mask(const int *list)
+{
+	uint64_t mask = 0;
+	for (; *list >= 0; ++list)
+		mask |= ((uint64_t)1) << *list;
+	return mask;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int
+_job_before(const struct job_s *a, const struct job_s *b)
+{
+	if (a->job.priority != b->job.priority)
+		return a->job.priority > b->job.priority;
+	// Same priority, keep the jobs sharing a plan next to each other
+	int c = memcmp(&a->key, &b->key, sizeof(struct plan_key_s));
+	if (c != 0)
+		return c < 0;
+	return a->seq < b->seq;
+}
+
+static int
+_queue_push(struct queue_s *q, struct job_s *job)
+{
+	if (q->len >= q->alloc) {
+		size_t alloc = q->alloc ? q->alloc * 2 : 64;
+		struct job_s **heap = realloc(q->heap, alloc * sizeof(struct job_s*));
+		if (!heap)
+			return 0;
+		q->heap = heap;
+		q->alloc = alloc;
+	}
+
+	size_t i = q->len++;
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (!_job_before(job, q->heap[parent]))
+			break;
+		q->heap[i] = q->heap[parent];
+		i = parent;
+	}
+	q->heap[i] = job;
+	return 1;
+}
+
+static struct job_s *
+_queue_pop(struct queue_s *q)
+{
+	pthread_mutex_lock(&q->lock);
+	if (!q->len) {
+		pthread_mutex_unlock(&q->lock);
+		return NULL;
+	}
+
+	struct job_s *top = q->heap[0];
+	struct job_s *last = q->heap[--q->len];
+	size_t i = 0;
+	for (;;) {
+		size_t child = 2 * i + 1;
+		if (child >= q->len)
+			break;
+		if (child + 1 < q->len && _job_before(q->heap[child + 1], q->heap[child]))
+			child ++;
+		if (!_job_before(q->heap[child], last))
+			break;
+		q->heap[i] = q->heap[child];
+		i = child;
+	}
+	if (q->len)
+		q->heap[i] = last;
+
+	pthread_mutex_unlock(&q->lock);
+	return top;
+}
+
+/* Pops from the worker's own queue, then steals from the others */
+static struct job_s *
+_next_job(struct rain_repair_s *rs, unsigned int id)
+{
+	for (unsigned int i = 0; i < rs->nb_queues; ++i) {
+		struct job_s *job = _queue_pop(rs->queues + ((id + i) % rs->nb_queues));
+		if (job) {
+			pthread_mutex_lock(&rs->lock);
+			rs->queued --;
+			pthread_mutex_unlock(&rs->lock);
+			return job;
+		}
+	}
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static struct rain_decode_plan_s *
+_plan_get(struct rain_repair_s *rs, struct job_s *job, uint64_t excluded)
+{
+	struct plan_key_s key = job->key;
+	key.excluded = excluded;
+
+	pthread_mutex_lock(&rs->lock);
+	for (struct plan_slot_s *slot = rs->plans; slot; slot = slot->next) {
+		if (!memcmp(&slot->key, &key, sizeof(key))) {
+			rs->stats.plans_shared ++;
+			pthread_mutex_unlock(&rs->lock);
+			return slot->plan;
+		}
+	}
+	pthread_mutex_unlock(&rs->lock);
+
+	// Not found, build it without holding the lock
+	const unsigned int sum = key.k + key.m;
+	int sources[key.k + 1];
+	unsigned int nb_sources = 0;
+	for (unsigned int i = 0; i < sum && nb_sources < key.k; ++i) {
+		uint64_t bit = ((uint64_t)1) << i;
+		if (!(key.targets & bit) && !(excluded & bit))
+			sources[nb_sources++] = i;
+	}
+	sources[nb_sources] = -1;
+	if (nb_sources < key.k) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	struct plan_slot_s *slot = calloc(1, sizeof(struct plan_slot_s));
+	if (!slot)
+		return NULL;
+	slot->key = key;
+	// The precomputed plans use the same sources as when nothing is excluded
+	if (!excluded && rs->cfg.plans) {
+		slot->plan = rain_plans_lookup(rs->cfg.plans, &job->job.encoding,
+				job->erasures);
+		slot->loaded = (slot->plan != NULL);
+	}
+	if (!slot->plan)
+		slot->plan = rain_decode_plan_create_ext(&job->job.encoding,
+				job->erasures, sources);
+	if (!slot->plan) {
+		free(slot);
+		return NULL;
+	}
+
+	// Another worker may have built it meanwhile
+	pthread_mutex_lock(&rs->lock);
+	for (struct plan_slot_s *s = rs->plans; s; s = s->next) {
+		if (!memcmp(&s->key, &key, sizeof(key))) {
+			rs->stats.plans_shared ++;
+			pthread_mutex_unlock(&rs->lock);
+			rain_decode_plan_free(slot->plan);
+			free(slot);
+			return s->plan;
+		}
+	}
+	slot->next = rs->plans;
+	rs->plans = slot;
+	rs->stats.plans_built ++;
+	if (slot->loaded)
+		rs->stats.plans_loaded ++;
+	pthread_mutex_unlock(&rs->lock);
+	return slot->plan;
+}
+
+static void
+_memory_acquire(struct rain_repair_s *rs, size_t size)
+{
+	pthread_mutex_lock(&rs->lock);
+	// A job larger than the whole budget runs alone
+	while (rs->cfg.memory_budget > 0 && rs->memory_used > 0
+			&& rs->memory_used + size > rs->cfg.memory_budget)
+		pthread_cond_wait(&rs->cond_memory, &rs->lock);
+	rs->memory_used += size;
+	if (rs->memory_used > rs->stats.memory_peak)
+		rs->stats.memory_peak = rs->memory_used;
+	pthread_mutex_unlock(&rs->lock);
+}
+
+static void
+_memory_release(struct rain_repair_s *rs, size_t size)
+{
+	pthread_mutex_lock(&rs->lock);
+	rs->memory_used -= size;
+	pthread_cond_broadcast(&rs->cond_memory);
+	pthread_mutex_unlock(&rs->lock);
+}
+
+/* Reserves a slot of 'size' bytes in the bandwidth budget, and waits
+ * for it to begin */
+static void
+_bandwidth_acquire(struct rain_repair_s *rs, size_t size)
+{
+	if (!rs->cfg.bandwidth_budget)
+		return;
+
+	pthread_mutex_lock(&rs->lock);
+	double now = _now();
+	double start = (rs->bandwidth_next > now) ? rs->bandwidth_next : now;
+	rs->bandwidth_next = start
+		+ ((double)size / (double)rs->cfg.bandwidth_budget);
+	pthread_mutex_unlock(&rs->lock);
+
+	if (start > now)
+		_sleep(start - now);
+}
+
+static int
+_run(struct rain_repair_s *rs, struct job_s *job)
+{
+	struct rain_encoding_s *enc = &job->job.encoding;
+	const unsigned int k = enc->k, m = enc->m;
+	const size_t bs = enc->block_size;
+
+	if (!job->nb_targets)
+		return 1;
+
+	// One buffer per source, plus one per target
+	const unsigned int nb_slots = k + job->nb_targets;
+	_memory_acquire(rs, nb_slots * bs);
+	uint8_t *area = rs->cfg.env->malloc(nb_slots * bs);
+	if (!area) {
+		_memory_release(rs, nb_slots * bs);
+		return 0;
+	}
+
+	uint8_t *data[k], *parity[m], *free_slots[nb_slots];
+	unsigned int nb_free = 0;
+	for (unsigned int i = 0; i < nb_slots; ++i)
+		free_slots[nb_free++] = area + (i * bs);
+	memset(data, 0, sizeof(data));
+	memset(parity, 0, sizeof(parity));
+#define SLOT(I) (((unsigned int)(I) < k) ? &data[(I)] : &parity[(I) - k])
+
+	for (unsigned int i = 0; i < job->nb_targets; ++i)
+		*SLOT(job->erasures[i]) = free_slots[--nb_free];
+
+	int ok = 0;
+	uint64_t excluded = 0, read = 0, written = 0;
+	struct rain_decode_plan_s *plan = NULL;
+	for (;;) {
+		plan = _plan_get(rs, job, excluded);
+		if (!plan)
+			break;
+
+		// Fetch the sources not fetched yet, replan on a failure
+		int missing = -1;
+		for (const int *s = rain_decode_plan_sources(plan); *s >= 0; ++s) {
+			uint8_t **slot = SLOT(*s);
+			if (*slot)
+				continue;
+			*slot = free_slots[--nb_free];
+			_bandwidth_acquire(rs, bs);
+			if (!job->job.fetch(job->job.udata, *s, *slot, bs)) {
+				free_slots[nb_free++] = *slot;
+				*slot = NULL;
+				missing = *s;
+				break;
+			}
+			read += bs;
+		}
+		if (missing < 0) {
+			ok = rain_decode_plan_apply(plan, enc, data, parity);
+			break;
+		}
+		excluded |= ((uint64_t)1) << missing;
+	}
+
+	for (unsigned int i = 0; ok && i < job->nb_targets; ++i) {
+		int idx = job->erasures[i];
+		if (!job->job.store(job->job.udata, idx, *SLOT(idx), bs))
+			ok = 0;
+		else
+			written += bs;
+	}
+#undef SLOT
+
+	rs->cfg.env->free(area);
+	_memory_release(rs, nb_slots * bs);
+
+	pthread_mutex_lock(&rs->lock);
+	rs->stats.bytes_read += read;
+	rs->stats.bytes_written += written;
+	pthread_mutex_unlock(&rs->lock);
+	return ok;
+}
+
+static void
+_snapshot(struct rain_repair_s *rs, struct rain_repair_stats_s *out)
+{
+	*out = rs->stats;
+	out->elapsed = _now() - rs->start;
+	if (out->elapsed > 0.0)
+		out->throughput = (double)out->bytes_written / out->elapsed;
+}
+
+static void *
+_worker(void *p)
+{
+	struct worker_s *self = p;
+	struct rain_repair_s *rs = self->rs;
+
+	for (;;) {
+		struct job_s *job = _next_job(rs, self->id);
+		if (!job) {
+			pthread_mutex_lock(&rs->lock);
+			while (!rs->queued && !rs->stopping)
+				pthread_cond_wait(&rs->cond_work, &rs->lock);
+			int leave = !rs->queued && rs->stopping;
+			pthread_mutex_unlock(&rs->lock);
+			if (leave)
+				break;
+			continue;
+		}
+
+		int ok = _run(rs, job);
+		if (job->job.done)
+			job->job.done(job->job.udata, ok);
+
+		struct rain_repair_stats_s stats;
+		pthread_mutex_lock(&rs->lock);
+		if (ok)
+			rs->stats.jobs_done ++;
+		else
+			rs->stats.jobs_failed ++;
+		_snapshot(rs, &stats);
+		pthread_mutex_unlock(&rs->lock);
+
+		if (rs->cfg.progress)
+			rs->cfg.progress(rs->cfg.progress_udata, &stats);
+
+		pthread_mutex_lock(&rs->lock);
+		rs->pending --;
+		pthread_cond_broadcast(&rs->cond_idle);
+		pthread_mutex_unlock(&rs->lock);
+
+		free(job);
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct rain_repair_s *
+rain_repair_create(const struct rain_repair_config_s *cfg)
+{
+	struct rain_repair_s *rs = calloc(1, sizeof(struct rain_repair_s));
+	if (!rs) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	if (cfg)
+		rs->cfg = *cfg;
+	if (!rs->cfg.env)
+		rs->cfg.env = &env_DEFAULT;
+	rs->nb_workers = rs->cfg.workers;
+	if (!rs->nb_workers) {
+		long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		rs->nb_workers = MACRO_COND(nb_cpus > 0, (unsigned int)nb_cpus, 1);
+	}
+	rs->start = _now();
+
+	pthread_mutex_init(&rs->lock, NULL);
+	pthread_cond_init(&rs->cond_work, NULL);
+	pthread_cond_init(&rs->cond_idle, NULL);
+	pthread_cond_init(&rs->cond_memory, NULL);
+
+	rs->queues = calloc(rs->nb_workers, sizeof(struct queue_s));
+	rs->workers = calloc(rs->nb_workers, sizeof(struct worker_s));
+	if (!rs->queues || !rs->workers) {
+		free(rs->queues);
+		free(rs->workers);
+		free(rs);
+		errno = ENOMEM;
+		return NULL;
+	}
+	rs->nb_queues = rs->nb_workers;
+	for (unsigned int i = 0; i < rs->nb_queues; ++i)
+		pthread_mutex_init(&rs->queues[i].lock, NULL);
+
+	unsigned int started = 0;
+	for (; started < rs->nb_workers; ++started) {
+		struct worker_s *w = rs->workers + started;
+		w->rs = rs;
+		w->id = started;
+		if (pthread_create(&w->thread, NULL, _worker, w) != 0)
+			break;
+	}
+	if (started < rs->nb_workers) {
+		// Only join the threads actually started, the queues stay as they
+		// are: the running workers steal from all of them
+		pthread_mutex_lock(&rs->lock);
+		rs->nb_workers = started;
+		pthread_mutex_unlock(&rs->lock);
+		if (!started) {
+			rain_repair_destroy(rs);
+			errno = EAGAIN;
+			return NULL;
+		}
+	}
+
+	return rs;
+}
+
+int
+rain_repair_submit(struct rain_repair_s *rs, const struct rain_repair_job_s *job)
+{
+	assert(rs != NULL);
+	assert(job != NULL);
+
+	const struct rain_encoding_s *enc = &job->encoding;
+	const unsigned int sum = enc->k + enc->m;
+	if (!job->fetch || !job->store || !job->erasures
+			|| sum > REPAIR_MAX_BLOCKS || !enc->block_size) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	struct job_s *j = calloc(1, sizeof(struct job_s));
+	if (!j) {
+		errno = ENOMEM;
+		return 0;
+	}
+	j->job = *job;
+	for (; job->erasures[j->nb_targets] >= 0; ++j->nb_targets) {
+		if (j->nb_targets >= enc->m
+				|| (unsigned int)job->erasures[j->nb_targets] >= sum) {
+			free(j);
+			errno = EINVAL;
+			return 0;
+		}
+		j->erasures[j->nb_targets] = job->erasures[j->nb_targets];
+	}
+	j->erasures[j->nb_targets] = -1;
+	j->job.erasures = j->erasures;
+
+	memset(&j->key, 0, sizeof(struct plan_key_s));
+	j->key.algo = enc->algo;
+	j->key.k = enc->k;
+	j->key.m = enc->m;
+	j->key.w = enc->w;
+	j->key.targets = _mask(j->erasures);
+
+	// Same profile and pattern, same worker
+	uint64_t h = 14695981039346656037ULL;
+	const uint8_t *b = (const uint8_t*) &j->key;
+	for (size_t i = 0; i < sizeof(struct plan_key_s); ++i)
+		h = (h ^ b[i]) * 1099511628211ULL;
+	struct queue_s *q = rs->queues + (h % rs->nb_queues);
+
+	pthread_mutex_lock(&rs->lock);
+	j->seq = rs->seq ++;
+	pthread_mutex_lock(&q->lock);
+	int rc = _queue_push(q, j);
+	pthread_mutex_unlock(&q->lock);
+	if (rc) {
+		rs->queued ++;
+		rs->pending ++;
+		rs->stats.jobs_submitted ++;
+		pthread_cond_signal(&rs->cond_work);
+	}
+	pthread_mutex_unlock(&rs->lock);
+
+	if (!rc) {
+		free(j);
+		errno = ENOMEM;
+	}
+	return rc;
+}
+
+void
+rain_repair_wait(struct rain_repair_s *rs)
+{
+	assert(rs != NULL);
+	pthread_mutex_lock(&rs->lock);
+	while (rs->pending > 0)
+		pthread_cond_wait(&rs->cond_idle, &rs->lock);
+	pthread_mutex_unlock(&rs->lock);
+}
+
+void
+rain_repair_get_stats(struct rain_repair_s *rs, struct rain_repair_stats_s *out)
+{
+	assert(rs != NULL);
+	assert(out != NULL);
+	pthread_mutex_lock(&rs->lock);
+	_snapshot(rs, out);
+	pthread_mutex_unlock(&rs->lock);
+}
+
+void
+rain_repair_destroy(struct rain_repair_s *rs)
+{
+	if (!rs)
+		return;
+
+	rain_repair_wait(rs);
+	pthread_mutex_lock(&rs->lock);
+	rs->stopping = 1;
+	pthread_cond_broadcast(&rs->cond_work);
+	pthread_mutex_unlock(&rs->lock);
+	for (unsigned int i = 0; i < rs->nb_workers; ++i)
+		pthread_join(rs->workers[i].thread, NULL);
+
+	while (rs->plans) {
+		struct plan_slot_s *slot = rs->plans;
+		rs->plans = slot->next;
+		rain_decode_plan_free(slot->plan);
+		free(slot);
+	}
+	for (unsigned int i = 0; i < rs->nb_queues; ++i) {
+		pthread_mutex_destroy(&rs->queues[i].lock);
+		free(rs->queues[i].heap);
+	}
+	pthread_cond_destroy(&rs->cond_memory);
+	pthread_cond_destroy(&rs->cond_idle);
+	pthread_cond_destroy(&rs->cond_work);
+	pthread_mutex_destroy(&rs->lock);
+	free(rs->queues);
+	free(rs->workers);
+	free(rs);
+}
@@ -0,0 +1,94 @@
+#ifndef LIBRAIN_rain_repair_h
+#define LIBRAIN_rain_repair_h 1
+
+#include <stdint.h>
+#include "librain.h"
+#include "rain_plans.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Counters of a repair scheduler, updated as the jobs complete */
+struct rain_repair_stats_s
+{
+	uint64_t jobs_submitted;
+	uint64_t jobs_done;
+	uint64_t jobs_failed;
+	uint64_t bytes_read; /**< Bytes fetched from the sources */
+	uint64_t bytes_written; /**< Bytes of rebuilt blocks stored */
+	uint64_t plans_built; /**< Decoding plans computed or loaded */
+	uint64_t plans_loaded; /**< Among them, plans loaded precomputed */
+	uint64_t plans_shared; /**< Jobs served with an already built plan */
+	size_t memory_peak; /**< Highest amount of block buffers in flight */
+	double elapsed; /**< Seconds since the scheduler was created */
+	double throughput; /**< Bytes rebuilt per second */
+};
+
+struct rain_repair_config_s
+{
+	unsigned int workers; /**< 0 means one per online CPU */
+	size_t memory_budget; /**< Max bytes of block buffers, 0 for unlimited */
+	size_t bandwidth_budget; /**< Max bytes fetched per second, 0 for unlimited */
+	struct rain_env_s *env; /**< can be NULL */
+
+	/** Precomputed plans (cf. rain_plans.h) loaded instead of being built,
+	 * can be NULL. Must stay open until the scheduler is destroyed. */
+	struct rain_plans_s *plans;
+
+	/** Called by the workers after each job, can be NULL */
+	void (*progress) (void *udata, const struct rain_repair_stats_s *stats);
+	void *progress_udata;
+};
+
+/** A repair job rebuilds the erased blocks of one object */
+struct rain_repair_job_s
+{
+	struct rain_encoding_s encoding;
+	int *erasures; /**< Blocks to rebuild, and a final -1. Copied. */
+	int priority; /**< Higher priorities are served first */
+
+	/** Reads the block 'index' (0 to k+m-1) into 'buf', 'len' bytes long.
+	 * @return a boolean value, false if the block is unavailable */
+	int (*fetch) (void *udata, unsigned int index, uint8_t *buf, size_t len);
+
+	/** Receives the rebuilt block 'index'.
+	 * @return a boolean value, false if it failed */
+	int (*store) (void *udata, unsigned int index, const uint8_t *buf,
+			size_t len);
+
+	/** Called once the job is over, can be NULL */
+	void (*done) (void *udata, int ok);
+	void *udata;
+};
+
+struct rain_repair_s;
+
+/** Starts the worker threads of a repair scheduler.
+ * @param cfg can be NULL for the defaults
+ * @return NULL on error (errno is set)
+ */
+struct rain_repair_s* rain_repair_create (const struct rain_repair_config_s *cfg);
+
+/** Queues a copy of 'job'. The jobs with the same profile and erasure
+ * pattern are grouped on the same worker and share their decoding plan,
+ * idle workers steal jobs from the busy ones.
+ * @return a boolean value, false if the job is invalid (errno is set)
+ */
+int rain_repair_submit (struct rain_repair_s *rs,
+		const struct rain_repair_job_s *job);
+
+/** Blocks until all the submitted jobs are over */
+void rain_repair_wait (struct rain_repair_s *rs);
+
+void rain_repair_get_stats (struct rain_repair_s *rs,
+		struct rain_repair_stats_s *out);
+
+/** Waits for the pending jobs, stops the workers and frees everything */
+void rain_repair_destroy (struct rain_repair_s *rs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBRAIN_rain_repair_h
@@ -0,0 +1,466 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "librain.h"
+#include "rain_fragment.h"
+#include "rain_repair.h"
+
+/* Simulates a cluster of storage nodes on the local host, to compare the
+ * repair traffic and cost of the profiles. The fragments of each object
+ * are placed on k+m distinct nodes, round-robin. Some nodes then fail:
+ * they come back empty, and the repair scheduler rebuilds the fragments
+ * they held from the other nodes. Each node serves one request at a time,
+ * with a latency and a bandwidth of its own.
+ *
+ * The nodes are kept in memory, or as directories of fragment files. */
+
+struct options_s
+{
+	unsigned int nodes; /**< 0 for k+m+2 */
+	unsigned int failures;
+	unsigned int objects;
+	size_t size;
+	double latency; /**< Seconds per request */
+	double bandwidth; /**< Bytes per second per node, 0 for unlimited */
+	unsigned int workers;
+	const char *dir; /**< NULL to keep the fragments in memory */
+	unsigned int seed;
+};
+
+struct node_s
+{
+	pthread_mutex_t lock;
+	double free_at; /**< When its link is idle again */
+	uint8_t **fragments; /**< In memory, per object, NULL if not held */
+};
+
+struct cluster_s
+{
+	const struct options_s *opt;
+	unsigned int nb_nodes;
+	struct node_s *nodes;
+};
+
+struct object_s
+{
+	struct cluster_s *cluster;
+	unsigned int index;
+	struct rain_encoding_s enc;
+	uint32_t crc[64]; /**< Of each fragment */
+	int erasures[65];
+	int ok;
+};
+
+static double
+_now (clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime (clock, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static unsigned int
+_node_of (const struct cluster_s *c, unsigned int object, unsigned int index)
+{
+	return (object + index) % c->nb_nodes;
+}
+
+static void
+_node_dir (const struct cluster_s *c, unsigned int node, char *path, size_t len)
+{
+	snprintf (path, len, "%s/node-%u", c->opt->dir, node);
+}
+
+static void
+_path (const struct cluster_s *c, unsigned int node, unsigned int object,
+		char *path, size_t len)
+{
+	snprintf (path, len, "%s/node-%u/%u", c->opt->dir, node, object);
+}
+
+/* Waits for the node to transfer 'len' bytes, after the requests queued
+ * before */
+static void
+_transfer (struct cluster_s *c, unsigned int node, size_t len)
+{
+	const struct options_s *opt = c->opt;
+	if (opt->latency <= 0.0 && opt->bandwidth <= 0.0)
+		return;
+
+	struct node_s *n = c->nodes + node;
+	double now = _now (CLOCK_MONOTONIC);
+	pthread_mutex_lock (&n->lock);
+	double start = (n->free_at > now) ? n->free_at : now;
+	n->free_at = start + opt->latency
+		+ ((opt->bandwidth > 0.0) ? (double)len / opt->bandwidth : 0.0);
+	double end = n->free_at;
+	pthread_mutex_unlock (&n->lock);
+
+	if (end > now) {
+		double delay = end - now;
+		struct timespec ts;
+		ts.tv_sec = (time_t) delay;
+		ts.tv_nsec = (long) ((delay - (double)ts.tv_sec) * 1e9);
+		while (nanosleep (&ts, &ts) < 0 && errno == EINTR) {}
+	}
+}
+
+static int
+_put (struct cluster_s *c, struct object_s *o, unsigned int index,
+		const uint8_t *block)
+{
+	const unsigned int node = _node_of (c, o->index, index);
+	if (!c->opt->dir) {
+		uint8_t *copy = malloc (o->enc.block_size);
+		if (!copy)
+			return 0;
+		memcpy (copy, block, o->enc.block_size);
+		c->nodes[node].fragments[o->index] = copy;
+		return 1;
+	}
+
+	char path[1024];
+	uint8_t id[RAIN_FRAGMENT_ID];
+	memset (id, 0, sizeof(id));
+	memcpy (id, &o->index, sizeof(o->index));
+	_path (c, node, o->index, path, sizeof(path));
+	return rain_fragment_write (path, &o->enc, index, id, block);
+}
+
+static int
+_get (struct cluster_s *c, struct object_s *o, unsigned int index,
+		uint8_t *buf)
+{
+	const unsigned int node = _node_of (c, o->index, index);
+	if (!c->opt->dir) {
+		const uint8_t *block = c->nodes[node].fragments[o->index];
+		if (!block)
+			return 0;
+		memcpy (buf, block, o->enc.block_size);
+		return 1;
+	}
+
+	char path[1024];
+	_path (c, node, o->index, path, sizeof(path));
+	struct rain_fragment_s *f = rain_fragment_open (path, 0);
+	if (!f)
+		return 0;
+	memcpy (buf, rain_fragment_block (f), o->enc.block_size);
+	rain_fragment_close (f);
+	return 1;
+}
+
+/* The node comes back empty */
+static void
+_wipe (struct cluster_s *c, unsigned int node, unsigned int nb_objects)
+{
+	char path[1024];
+	for (unsigned int i = 0; i < nb_objects; ++i) {
+		if (!c->opt->dir) {
+			free (c->nodes[node].fragments[i]);
+			c->nodes[node].fragments[i] = NULL;
+		} else {
+			_path (c, node, i, path, sizeof(path));
+			unlink (path);
+		}
+	}
+}
+
+static int
+_fetch (void *udata, unsigned int index, uint8_t *buf, size_t len)
+{
+	struct object_s *o = udata;
+	_transfer (o->cluster, _node_of (o->cluster, o->index, index), len);
+	return _get (o->cluster, o, index, buf);
+}
+
+static int
+_store (void *udata, unsigned int index, const uint8_t *buf, size_t len)
+{
+	struct object_s *o = udata;
+	_transfer (o->cluster, _node_of (o->cluster, o->index, index), len);
+	return _put (o->cluster, o, index, buf);
+}
+
+static void
+_done (void *udata, int ok)
+{
+	struct object_s *o = udata;
+	o->ok = ok;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int
+_populate (struct cluster_s *c, struct object_s *objects, const char *algo,
+		unsigned int k, unsigned int m)
+{
+	const struct options_s *opt = c->opt;
+	for (unsigned int i = 0; i < opt->objects; ++i) {
+		struct object_s *o = objects + i;
+		o->cluster = c;
+		o->index = i;
+		if (!rain_get_encoding (&o->enc, opt->size, k, m, algo))
+			return 0;
+
+		uint8_t *buf = malloc (o->enc.padded_data_size);
+		if (!buf)
+			return 0;
+		for (size_t j = 0; j < opt->size; ++j)
+			buf[j] = random () & 0xFF;
+		memset (buf + opt->size, 0, o->enc.padded_data_size - opt->size);
+		uint8_t *parity[m];
+		if (!rain_encode (buf, opt->size, &o->enc, NULL, parity)) {
+			free (buf);
+			return 0;
+		}
+
+		int rc = 1;
+		for (unsigned int j = 0; j < k + m; ++j) {
+			const uint8_t *block = (j < k)
+				? buf + (j * o->enc.block_size) : parity[j - k];
+			o->crc[j] = rain_crc32c (0, block, o->enc.block_size);
+			if (rc && !_put (c, o, j, block))
+				rc = 0;
+		}
+		for (unsigned int j = 0; j < m; ++j)
+			free (parity[j]);
+		free (buf);
+		if (!rc)
+			return 0;
+	}
+	return 1;
+}
+
+/* All the fragments are back, and intact */
+static int
+_verify (struct cluster_s *c, struct object_s *objects)
+{
+	for (unsigned int i = 0; i < c->opt->objects; ++i) {
+		struct object_s *o = objects + i;
+		uint8_t *buf = malloc (o->enc.block_size);
+		int rc = (buf != NULL);
+		for (unsigned int j = 0; rc && j < o->enc.k + o->enc.m; ++j) {
+			rc = _get (c, o, j, buf)
+				&& rain_crc32c (0, buf, o->enc.block_size) == o->crc[j];
+		}
+		free (buf);
+		if (!rc)
+			return 0;
+	}
+	return 1;
+}
+
+static int
+_bench (const struct options_s *opt, const char *profile)
+{
+	char algo[32];
+	unsigned int k = 0, m = 0;
+	struct rain_encoding_s enc;
+	if (sscanf (profile, "%31[^:]:%u:%u", algo, &k, &m) != 3
+			|| !rain_get_encoding (&enc, opt->size, k, m, algo)
+			|| k + m > 64) {
+		fprintf (stderr, "Invalid profile [%s], expected algo:k:m\n", profile);
+		return 0;
+	}
+
+	struct cluster_s c;
+	c.opt = opt;
+	c.nb_nodes = opt->nodes ? opt->nodes : k + m + 2;
+	if (c.nb_nodes < k + m) {
+		fprintf (stderr, "[%s] needs %u nodes at least\n", profile, k + m);
+		return 0;
+	}
+	c.nodes = calloc (c.nb_nodes, sizeof(struct node_s));
+	struct object_s *objects = calloc (opt->objects, sizeof(struct object_s));
+	for (unsigned int i = 0; i < c.nb_nodes; ++i) {
+		pthread_mutex_init (&c.nodes[i].lock, NULL);
+		c.nodes[i].fragments = calloc (opt->objects, sizeof(uint8_t*));
+		if (opt->dir) {
+			char path[1024];
+			_node_dir (&c, i, path, sizeof(path));
+			mkdir (path, 0755);
+		}
+	}
+
+	// The failures only depend on the seed and the number of nodes
+	srandom (opt->seed);
+	unsigned int failed[c.nb_nodes], nb_failed = 0;
+	const unsigned int failures = (opt->failures < m) ? opt->failures : m;
+	while (nb_failed < failures) {
+		unsigned int node = random () % c.nb_nodes, i = 0;
+		for (; i < nb_failed && failed[i] != node; ++i) {}
+		if (i == nb_failed)
+			failed[nb_failed++] = node;
+	}
+
+	int rc = _populate (&c, objects, algo, k, m);
+	if (!rc)
+		fprintf (stderr, "[%s] cannot store the fragments: %s\n", profile,
+				strerror(errno));
+	for (unsigned int f = 0; rc && f < nb_failed; ++f)
+		_wipe (&c, failed[f], opt->objects);
+
+	struct rain_repair_stats_s st;
+	memset (&st, 0, sizeof(st));
+	double wall = 0.0, cpu = 0.0;
+	unsigned int nb_rebuilt = 0;
+	if (rc) {
+		struct rain_repair_config_s cfg;
+		memset (&cfg, 0, sizeof(cfg));
+		cfg.workers = opt->workers;
+		double wall0 = _now (CLOCK_MONOTONIC);
+		double cpu0 = _now (CLOCK_PROCESS_CPUTIME_ID);
+		struct rain_repair_s *rs = rain_repair_create (&cfg);
+
+		for (unsigned int i = 0; rs && i < opt->objects; ++i) {
+			struct object_s *o = objects + i;
+			unsigned int nb = 0;
+			for (unsigned int j = 0; j < k + m; ++j) {
+				for (unsigned int f = 0; f < nb_failed; ++f) {
+					if (_node_of (&c, i, j) == failed[f])
+						o->erasures[nb++] = j;
+				}
+			}
+			o->erasures[nb] = -1;
+			o->ok = 1;
+			if (!nb)
+				continue;
+			nb_rebuilt += nb;
+
+			struct rain_repair_job_s job;
+			memset (&job, 0, sizeof(job));
+			job.encoding = o->enc;
+			job.erasures = o->erasures;
+			job.fetch = _fetch;
+			job.store = _store;
+			job.done = _done;
+			job.udata = o;
+			if (!rain_repair_submit (rs, &job))
+				o->ok = 0;
+		}
+		if (rs) {
+			rain_repair_wait (rs);
+			rain_repair_get_stats (rs, &st);
+			rain_repair_destroy (rs);
+		}
+		cpu = _now (CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+		wall = _now (CLOCK_MONOTONIC) - wall0;
+
+		rc = (rs != NULL) && st.jobs_failed == 0;
+		for (unsigned int i = 0; rc && i < opt->objects; ++i)
+			rc = objects[i].ok;
+		if (rc && !_verify (&c, objects))
+			rc = 0;
+		if (!rc)
+			fprintf (stderr, "[%s] repair failed\n", profile);
+	}
+
+	if (rc) {
+		const double MiB = 1024.0 * 1024.0;
+		printf ("%-16s %5u %6u %7u %7u %10.1f %10.1f %8.3f %8.3f %8.1f\n",
+				profile, c.nb_nodes, nb_failed, opt->objects, nb_rebuilt,
+				(double)st.bytes_read / MiB, (double)st.bytes_written / MiB,
+				cpu, wall, (wall > 0.0) ? (double)st.bytes_written / MiB / wall : 0.0);
+		fflush (stdout);
+	}
+
+	for (unsigned int i = 0; i < c.nb_nodes; ++i) {
+		_wipe (&c, i, opt->objects);
+		if (opt->dir) {
+			char path[1024];
+			_node_dir (&c, i, path, sizeof(path));
+			rmdir (path);
+		}
+		free (c.nodes[i].fragments);
+		pthread_mutex_destroy (&c.nodes[i].lock);
+	}
+	free (c.nodes);
+	free (objects);
+	return rc;
+}
+
+static size_t
+_parse_size (const char *s)
+{
+	char *end = NULL;
+	size_t v = strtoull (s, &end, 10);
+	switch (end ? *end : 0) {
+		case 'k': case 'K': return v << 10;
+		case 'm': case 'M': return v << 20;
+		case 'g': case 'G': return v << 30;
+		default: return v;
+	}
+}
+
+static void
+_usage (const char *prog)
+{
+	fprintf (stderr, "Usage: %s [OPTIONS] [algo:k:m]...\n"
+			" -n NODES      nodes in the cluster (default k+m+2)\n"
+			" -f FAILURES   nodes failing at once, at most m (default 1)\n"
+			" -o OBJECTS    objects stored (default 64)\n"
+			" -s SIZE       size of each object, with k/M/G suffixes (default 1M)\n"
+			" -l LATENCY    latency of each request in microseconds (default 0)\n"
+			" -b BANDWIDTH  bandwidth of each node in MiB/s (default unlimited)\n"
+			" -w WORKERS    repair threads (default one per CPU)\n"
+			" -d DIR        keep the fragments as files under DIR\n"
+			" -r SEED       seed of the objects and the failures (default 1)\n",
+			prog);
+}
+
+int
+main (int argc, char **argv)
+{
+	static const char *defaults[] = {
+		"liber8tion:6:2", "crs:6:2", "crs_min:6:2",
+		"crs:8:4", "crs_min:8:4", "crs:10:4", "crs_min:10:4",
+	};
+	struct options_s opt;
+	memset (&opt, 0, sizeof(opt));
+	opt.failures = 1;
+	opt.objects = 64;
+	opt.size = 1 << 20;
+	opt.seed = 1;
+
+	int c;
+	while ((c = getopt (argc, argv, "n:f:o:s:l:b:w:d:r:h")) != -1) {
+		switch (c) {
+			case 'n': opt.nodes = atoi (optarg); break;
+			case 'f': opt.failures = atoi (optarg); break;
+			case 'o': opt.objects = atoi (optarg); break;
+			case 's': opt.size = _parse_size (optarg); break;
+			case 'l': opt.latency = atof (optarg) / 1e6; break;
+			case 'b': opt.bandwidth = atof (optarg) * 1024.0 * 1024.0; break;
+			case 'w': opt.workers = atoi (optarg); break;
+			case 'd': opt.dir = optarg; break;
+			case 'r': opt.seed = atoi (optarg); break;
+			default:
+				_usage (argv[0]);
+				return c == 'h' ? 0 : 1;
+		}
+	}
+	if (!opt.objects || !opt.size) {
+		_usage (argv[0]);
+		return 1;
+	}
+
+	printf ("%-16s %5s %6s %7s %7s %10s %10s %8s %8s %8s\n", "profile",
+			"nodes", "failed", "objects", "rebuilt", "read_MiB", "write_MiB",
+			"cpu_s", "wall_s", "MiB/s");
+	int rc = 0;
+	if (optind < argc) {
+		for (int i = optind; i < argc; ++i)
+			rc |= !_bench (&opt, argv[i]);
+	} else {
+		for (unsigned int i = 0; i < sizeof(defaults) / sizeof(defaults[0]); ++i)
+			rc |= !_bench (&opt, defaults[i]);
+	}
+	return rc;
+}
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+
+#include "librain.h"
+#include "rain_stream.h"
+#include "utils.h"
+
+static struct rain_env_s env_DEFAULT = { malloc, calloc, free };
+
+static int
+_erased(const int *erasures, unsigned int index)
+{
+	for (; *erasures >= 0; ++erasures) {
+		if ((unsigned int)*erasures == index)
+			return 1;
+	}
+	return 0;
+}
+
+struct window_s
+{
+	struct rain_stream_s *st;
+	uint8_t *buf;
+	size_t size; /**< The size of each buffer, a multiple of the strip size */
+};
+
+static int
+_emit(struct window_s *win, unsigned int index, size_t offset,
+		const uint8_t *buf, size_t len)
+{
+	struct rain_stream_s *st = win->st;
+	int rc;
+	if (st->mode == RAIN_STREAM_BLOCKS) {
+		rc = st->write(st->udata, index, offset, buf, len);
+	} else {
+		// Only the object, not its padding
+		const struct rain_encoding_s *enc = st->encoding;
+		offset += index * enc->block_size;
+		if (offset >= enc->data_size)
+			return 1;
+		len = MACRO_COND(len > enc->data_size - offset,
+				enc->data_size - offset, len);
+		rc = st->write(st->udata, -1, offset, buf, len);
+	}
+	if (!rc)
+		errno = EIO;
+	return rc;
+}
+
+/* Runs the plan on the range of the blocks starting at 'offset', made of
+ * whole stripes of the same packet size, and emits its targets. Without a
+ * plan, the range of the block 'index' is just copied. */
+static int
+_stream_range(struct window_s *win, const struct rain_decode_plan_s *plan,
+		unsigned int index, size_t offset, size_t len, size_t tail_packet_size)
+{
+	struct rain_stream_s *st = win->st;
+	struct rain_encoding_s *enc = st->encoding;
+
+	if (!plan) {
+		if (!st->read(st->udata, index, offset, win->buf, len)) {
+			errno = EIO;
+			return 0;
+		}
+		return _emit(win, index, offset, win->buf, len);
+	}
+
+	// The range as an encoding of its own, the plan applies to it as is
+	struct rain_encoding_s sub = *enc;
+	sub.block_size = len;
+	sub.tail_packet_size = tail_packet_size;
+
+	uint8_t *data[enc->k], *parity[enc->m];
+	memset(data, 0, sizeof(data));
+	memset(parity, 0, sizeof(parity));
+	uint8_t *b = win->buf;
+	for (const int *s = rain_decode_plan_sources(plan); *s >= 0; ++s) {
+		if (!st->read(st->udata, *s, offset, b, len)) {
+			errno = EIO;
+			return 0;
+		}
+		if ((unsigned int)*s < enc->k)
+			data[*s] = b;
+		else
+			parity[*s - enc->k] = b;
+		b += win->size;
+	}
+	for (const int *t = rain_decode_plan_targets(plan); *t >= 0; ++t) {
+		if ((unsigned int)*t < enc->k)
+			data[*t] = b;
+		else
+			parity[*t - enc->k] = b;
+		b += win->size;
+	}
+	if (!rain_decode_plan_apply(plan, &sub, data, parity))
+		return 0;
+
+	for (const int *t = rain_decode_plan_targets(plan); *t >= 0; ++t) {
+		const uint8_t *out = ((unsigned int)*t < enc->k)
+			? data[*t] : parity[*t - enc->k];
+		if (!_emit(win, *t, offset, out, len))
+			return 0;
+	}
+	return 1;
+}
+
+/* The whole blocks, as many stripes as the window holds at once, then
+ * the tail stripe if any */
+static int
+_stream_blocks(struct window_s *win, const struct rain_decode_plan_s *plan,
+		unsigned int index)
+{
+	const struct rain_encoding_s *enc = win->st->encoding;
+	const size_t tail = enc->w * enc->tail_packet_size;
+	const size_t head = enc->block_size - tail;
+
+	// The padding of the object is not even read
+	size_t end = enc->block_size;
+	if (win->st->mode == RAIN_STREAM_OBJECT) {
+		size_t remaining = enc->data_size - (index * enc->block_size);
+		end = MACRO_COND(remaining < end, remaining, end);
+	}
+
+	for (size_t offset = 0; offset < head && offset < end; ) {
+		size_t len = MACRO_COND(head - offset < win->size, head - offset, win->size);
+		if (!_stream_range(win, plan, index, offset, len, 0))
+			return 0;
+		offset += len;
+	}
+	if (tail > 0 && head < end)
+		return _stream_range(win, plan, index, head, tail, enc->tail_packet_size);
+	return 1;
+}
+
+int
+rain_stream_rehydrate(struct rain_stream_s *st)
+{
+	assert(st != NULL);
+	assert(st->encoding != NULL);
+	assert(st->read != NULL);
+	assert(st->write != NULL);
+
+	struct rain_env_s *env = st->env ? st->env : &env_DEFAULT;
+	struct rain_encoding_s *enc = st->encoding;
+	const unsigned int k = enc->k, sum = enc->k + enc->m;
+	int *erasures = st->erasures;
+	int none = -1;
+	if (!erasures)
+		erasures = &none;
+
+	unsigned int nb_erased = 0;
+	for (; erasures[nb_erased] >= 0; ++nb_erased) {}
+	if (st->mode != RAIN_STREAM_OBJECT && st->mode != RAIN_STREAM_BLOCKS) {
+		errno = EINVAL;
+		return 0;
+	}
+	if (st->mode == RAIN_STREAM_BLOCKS && !nb_erased)
+		return 1;
+
+	// The first k intact blocks are read to rebuild the others
+	int sources[k + 1];
+	unsigned int nb_sources = 0;
+	for (unsigned int i = 0; i < sum && nb_sources < k; ++i) {
+		if (!_erased(erasures, i))
+			sources[nb_sources++] = i;
+	}
+	sources[nb_sources] = -1;
+	if (nb_sources < k || nb_erased > enc->m) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	// A buffer per source and per target, of whole strips
+	const unsigned int nb_buffers = k + ((st->mode == RAIN_STREAM_BLOCKS)
+			? nb_erased : 1);
+	struct window_s win;
+	win.st = st;
+	win.size = _lower_multiple(st->memory / nb_buffers, enc->strip_size);
+	win.size = MACRO_COND(win.size < enc->strip_size, enc->strip_size, win.size);
+	win.size = MACRO_COND(win.size > enc->block_size,
+			_upper_multiple(enc->block_size, enc->strip_size), win.size);
+	win.buf = env->malloc(nb_buffers * win.size);
+	if (!win.buf) {
+		errno = ENOMEM;
+		return 0;
+	}
+
+	int rc = 1;
+	if (st->mode == RAIN_STREAM_BLOCKS) {
+		struct rain_decode_plan_s *plan = rain_decode_plan_create_ext(enc,
+				erasures, sources);
+		rc = plan && _stream_blocks(&win, plan, 0);
+		if (plan)
+			rain_decode_plan_free(plan);
+	} else {
+		for (unsigned int i = 0; rc && i < k; ++i) {
+			if (i * enc->block_size >= enc->data_size)
+				break;
+			int target[2] = { i, -1 };
+			struct rain_decode_plan_s *plan = NULL;
+			if (_erased(erasures, i)) {
+				plan = rain_decode_plan_create_ext(enc, target, sources);
+				if (!plan) {
+					rc = 0;
+					break;
+				}
+			}
+			rc = _stream_blocks(&win, plan, i);
+			if (plan)
+				rain_decode_plan_free(plan);
+		}
+	}
+
+	env->free(win.buf);
+	return rc;
+}
@@ -0,0 +1,63 @@
+#ifndef LIBRAIN_rain_stream_h
+#define LIBRAIN_rain_stream_h 1
+
+#include <stdint.h>
+#include "librain.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Streaming rehydration: the surviving blocks are read range by range,
+ * the missing ranges are rebuilt in a small window of buffers and pushed
+ * to a sink, so that the memory used does not depend on the size of the
+ * object. */
+
+/** The sink receives the original object, in order and without padding */
+#define RAIN_STREAM_OBJECT 0
+
+/** The sink receives the rebuilt blocks, in order for each of them */
+#define RAIN_STREAM_BLOCKS 1
+
+struct rain_stream_s
+{
+	struct rain_encoding_s *encoding;
+	int *erasures; /**< The missing blocks, and a final -1 */
+	int mode; /**< RAIN_STREAM_OBJECT or RAIN_STREAM_BLOCKS */
+
+	/** The maximum size of the buffers. At least one strip per block
+	 * involved is always used, whatever this budget. 0 for the minimum. */
+	size_t memory;
+	struct rain_env_s *env; /**< can be NULL */
+
+	/** Reads 'len' bytes at 'offset' of the block 'index' (0 to k+m-1).
+	 * @return a boolean value, false if it failed */
+	int (*read) (void *udata, unsigned int index, size_t offset,
+			uint8_t *buf, size_t len);
+
+	/** Receives 'len' bytes at 'offset' of the object (then 'index' is -1)
+	 * or of the rebuilt block 'index', depending on the mode.
+	 * @return a boolean value, false to abort */
+	int (*write) (void *udata, int index, size_t offset,
+			const uint8_t *buf, size_t len);
+
+	void *udata;
+};
+
+/**
+ * In RAIN_STREAM_OBJECT mode, the data blocks are produced one after the
+ * other: the available ones are copied, each missing one is rebuilt from
+ * k blocks, read for that purpose. In RAIN_STREAM_BLOCKS mode, all the
+ * erased blocks are rebuilt at once, from k blocks read only once.
+ *
+ * @param stream cannot be NULL
+ * @return a boolean value, false if it failed (errno is set, EIO when a
+ *   callback failed)
+ */
+int rain_stream_rehydrate (struct rain_stream_s *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBRAIN_rain_stream_h
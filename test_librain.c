@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <alloca.h>
 
 #include "./librain.h"
@@ -11,6 +12,7 @@ _algo_to_str (enum rain_algorithm_e algo)
 	switch (algo) {
 		case JALG_liberation: return "liber8tion";
 		case JALG_crs: return "crs";
+		case JALG_crs_min: return "crs_min";
 		default: return "invalid";
 	}
 }
@@ -44,6 +46,80 @@ test_sizes_around (size_t length, const char *algo,
 	test_size (length+3, algo, k, m);
 }
 
+/* The former brute-force planner, the default layout must not change */
+static size_t
+_reference_packet_size (size_t ds, unsigned int k, unsigned int w)
+{
+	if (ds > 0) {
+		for (size_t start = 2048; start >= 1280; start -= 256) {
+			for (size_t p_size = start; p_size >= 64; p_size /= 2) {
+				size_t padded = _upper_multiple (ds, k * w * p_size);
+				size_t block = padded / k;
+				if ((padded != ds) && (ds < (padded - block)))
+					continue;
+				return p_size;
+			}
+		}
+	}
+	return 64;
+}
+
+static void
+_check_layout (size_t length, const char *algo, unsigned int k, unsigned int m)
+{
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding (&enc, length, k, m, algo);
+	assert (rc != 0);
+	assert (enc.packet_size == _reference_packet_size (length, k, enc.w));
+	assert (enc.tail_packet_size == 0);
+	assert (enc.padded_data_size == _upper_multiple (MACRO_COND(length>0,length,1),
+				k * enc.strip_size));
+
+	rc = rain_get_encoding_ext (&enc, length, k, m, algo, LIBRAIN_TAIL_STRIPE);
+	assert (rc != 0);
+	assert (enc.padded_data_size == k * enc.block_size);
+	assert (enc.padded_data_size >= length);
+	assert (enc.padded_data_size - length < enc.strip_size);
+	assert (length == 0
+			|| enc.padded_data_size - length < k * enc.w * LIBRAIN_TAIL_ALIGN);
+	assert (enc.tail_packet_size <= enc.packet_size);
+	assert (enc.tail_packet_size % LIBRAIN_TAIL_ALIGN == 0);
+	assert ((enc.block_size - enc.w * enc.tail_packet_size) % enc.strip_size == 0);
+}
+
+static void
+test_layout_sweep (const char *algo, unsigned int k, unsigned int m)
+{
+	for (size_t length = 0; length < 256*kiB ; ++length)
+		_check_layout (length, algo, k, m);
+	for (size_t length = 256*kiB; length < 64*MiB ; length += 4099)
+		_check_layout (length, algo, k, m);
+	for (size_t length = 64*MiB; length < 8UL*GiB ; length = length * 3 + 1)
+		_check_layout (length, algo, k, m);
+}
+
+static void
+test_layout_timing (const char *algo, unsigned int k, unsigned int m, int flags)
+{
+	const size_t count = 1000000;
+	struct rain_encoding_s enc;
+	struct timespec pre, post;
+	size_t total = 0;
+
+	clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &pre);
+	for (size_t i=1; i <= count ;++i) {
+		rain_get_encoding_ext (&enc, i * 7919, k, m, algo, flags);
+		total += enc.block_size;
+	}
+	clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &post);
+
+	size_t elapsed = _elapsed_msec (pre, post);
+	PRINTF ("LAYOUT %s %u+%u flags=%d %lu plans in %lu ms (%lu)\n",
+			algo, k, m, flags, count, elapsed, total);
+	// Less than a microsecond each
+	assert (elapsed < count / 1000);
+}
+
 static void
 test_encoding (size_t length, const char *algo, unsigned int k, unsigned int m)
 {
@@ -137,6 +213,37 @@ test_rehydrate (struct rain_encoding_s *enc, uint8_t **data, uint8_t **parity,
 	}
 }
 
+static unsigned int
+_count_encoding_ones (const char *algo, unsigned int k, unsigned int m)
+{
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding (&enc, 1, k, m, algo);
+	assert (rc != 0);
+
+	int targets[m+1];
+	for (unsigned int i=0; i<m ;++i)
+		targets[i] = k + i;
+	targets[m] = -1;
+	struct rain_decode_plan_s *plan = rain_decode_plan_create_ext (&enc, targets, NULL);
+	assert (plan != NULL);
+
+	unsigned int ones = 0;
+	const int *bm = rain_decode_plan_bitmatrix (plan);
+	for (unsigned int i=0; i < m * enc.w * k * enc.w ;++i)
+		ones += bm[i];
+	rain_decode_plan_free (plan);
+	return ones;
+}
+
+static void
+test_xor_weight (unsigned int k, unsigned int m)
+{
+	unsigned int crs = _count_encoding_ones ("crs", k, m);
+	unsigned int crs_min = _count_encoding_ones ("crs_min", k, m);
+	PRINTF ("ONES %u+%u crs=%u crs_min=%u\n", k, m, crs, crs_min);
+	assert (crs_min <= crs);
+}
+
 struct rehydrator_s
 {
 	struct rain_encoding_s *enc;
@@ -166,13 +273,14 @@ _generator_rehydrate(struct rehydrator_s *gen,
 }
 
 static void
-test_roundtrip (size_t length, const char *algo, unsigned int k, unsigned int m)
+test_roundtrip_flags (size_t length, const char *algo, unsigned int k,
+		unsigned int m, int flags)
 {
 	struct rain_encoding_s enc;
 	struct rehydrator_s gen;
 	int rc;
 
-	rc = rain_get_encoding (&enc, length, k, m, algo);
+	rc = rain_get_encoding_ext (&enc, length, k, m, algo, flags);
 	if (!rc)
 		return;
 
@@ -209,6 +317,435 @@ test_roundtrip (size_t length, const char *algo, unsigned int k, unsigned int m)
 	}
 }
 
+static void
+test_roundtrip (size_t length, const char *algo, unsigned int k, unsigned int m)
+{
+	test_roundtrip_flags (length, algo, k, m, 0);
+}
+
+/* Cuts 'buf' in random segments, some empty, some of a single byte */
+static int
+_random_segments (uint8_t *buf, size_t length, struct iovec *iov, int max)
+{
+	int count = 0;
+	size_t offset = 0;
+	while (offset < length && count < max - 1) {
+		size_t len = (size_t) random () % 4;
+		if (len == 3)
+			len = (size_t) random () % (length / 4 + 1);
+		len = MACRO_COND(len > length - offset, length - offset, len);
+		iov[count].iov_base = buf + offset;
+		iov[count].iov_len = len;
+		offset += len;
+		count ++;
+	}
+	iov[count].iov_base = buf + offset;
+	iov[count].iov_len = length - offset;
+	return count + 1;
+}
+
+static void
+test_iov (size_t length, const char *algo, unsigned int k, unsigned int m,
+		int flags)
+{
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding_ext (&enc, length, k, m, algo, flags);
+	assert (rc != 0);
+
+	uint8_t *buf = malloc (enc.padded_data_size);
+	randomize (buf, length);
+	memset (buf + length, 0, enc.padded_data_size - length);
+	uint8_t *parity[m], *parity_iov[m];
+	rc = rain_encode (buf, length, &enc, NULL, parity);
+	assert (rc != 0);
+
+	// Same parity, whatever the segmentation
+	struct iovec iov[64];
+	int iovcnt = 1;
+	iov[0].iov_base = buf;
+	iov[0].iov_len = length;
+	for (int pass=0; pass<2 ;++pass) {
+		rc = rain_encode_iov (iov, iovcnt, &enc, NULL, parity_iov);
+		assert (rc != 0);
+		for (unsigned int i=0; i<m ;++i) {
+			assert (0 == memcmp (parity[i], parity_iov[i], enc.block_size));
+			free (parity_iov[i]);
+		}
+		iovcnt = _random_segments (buf, length, iov, 64);
+	}
+
+	// Lose up to m data blocks, get the object back in other segments
+	uint8_t *out = malloc (length + 1);
+	uint8_t *data[k];
+	for (unsigned int lost=0; lost <= m && lost <= k ;++lost) {
+		for (unsigned int i=0; i<k ;++i)
+			data[i] = (i < lost) ? NULL : buf + (i * enc.block_size);
+		memset (out, 0, length + 1);
+		iovcnt = _random_segments (out, length, iov, 64);
+		rc = rain_rehydrate_iov (data, parity, &enc, NULL, iov, iovcnt);
+		assert (rc != 0);
+		assert (0 == memcmp (out, buf, length));
+		assert (out[length] == 0);
+	}
+
+	// Too short an output
+	if (length > 0) {
+		iov[0].iov_base = out;
+		iov[0].iov_len = length - 1;
+		rc = rain_rehydrate_iov (data, parity, &enc, NULL, iov, 1);
+		assert (rc == 0);
+	}
+
+	free (out);
+	free (buf);
+	for (unsigned int i=0; i<m ;++i)
+		free (parity[i]);
+}
+
+static double
+_plan_cost (struct rain_encoding_s *enc, struct rain_decode_plan_s *plan,
+		const double *costs, double byte_cost)
+{
+	double cost = 0.0;
+	for (const int *s = rain_decode_plan_sources (plan); *s >= 0 ;++s)
+		cost += costs[*s];
+	return cost + byte_cost * rain_decode_plan_operations (plan)
+		* (double)(enc->block_size / enc->w);
+}
+
+/* The chosen sources cost the same as the best of all the subsets, and
+ * the plan rebuilds the data blocks not read */
+static void
+test_choose (size_t length, const char *algo, unsigned int k, unsigned int m)
+{
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding (&enc, length, k, m, algo);
+	assert (rc != 0);
+	const unsigned int sum = k + m;
+
+	uint8_t *buf = malloc (enc.padded_data_size);
+	randomize (buf, length);
+	memset (buf + length, 0, enc.padded_data_size - length);
+	uint8_t *parity[m];
+	rc = rain_encode (buf, length, &enc, NULL, parity);
+	assert (rc != 0);
+
+	// All the blocks at the same cost, the data blocks win
+	int available[sum + 1];
+	for (unsigned int i=0; i<sum ;++i)
+		available[i] = i;
+	available[sum] = -1;
+	struct rain_decode_plan_s *plan = rain_decode_plan_choose (&enc,
+			available, NULL, 1.0);
+	assert (plan != NULL);
+	for (unsigned int i=0; i<k ;++i)
+		assert (rain_decode_plan_sources (plan)[i] == (int)i);
+	assert (rain_decode_plan_operations (plan) == 0);
+	rain_decode_plan_free (plan);
+
+	double costs[sum];
+	for (unsigned int round=0; round<20 ;++round) {
+		// Lose up to m blocks, pick random fetch costs
+		unsigned int nb = 0;
+		for (unsigned int i=0; i<sum ;++i) {
+			costs[i] = (double)(random () % 1000);
+			if (nb + (sum - i) <= k || random () % 4)
+				available[nb++] = i;
+		}
+		available[nb] = -1;
+		const double byte_cost = (round % 2) ? 0.0 : 0.01 / (double)(round + 1);
+
+		plan = rain_decode_plan_choose (&enc, available, costs, byte_cost);
+		assert (plan != NULL);
+		double chosen = _plan_cost (&enc, plan, costs, byte_cost);
+
+		// Brute force
+		double best = -1.0;
+		for (uint64_t mask=0; mask < (1ULL << nb) ;++mask) {
+			if (_count_bits (mask) != k)
+				continue;
+			int sources[k+1], targets[k+1];
+			unsigned int ns = 0, nt = 0;
+			for (unsigned int i=0; i<nb ;++i) {
+				if (mask & (1ULL << i))
+					sources[ns++] = available[i];
+			}
+			sources[ns] = -1;
+			for (unsigned int i=0; i<k ;++i) {
+				int found = 0;
+				for (unsigned int j=0; j<ns ;++j)
+					found |= (sources[j] == (int)i);
+				if (!found)
+					targets[nt++] = i;
+			}
+			targets[nt] = -1;
+			struct rain_decode_plan_s *p = rain_decode_plan_create_ext (&enc,
+					targets, sources);
+			assert (p != NULL);
+			double cost = _plan_cost (&enc, p, costs, byte_cost);
+			if (best < 0.0 || cost < best)
+				best = cost;
+			rain_decode_plan_free (p);
+		}
+		assert (chosen <= best + 1e-9 && chosen >= best - 1e-9);
+
+		// Rebuild the data blocks from the chosen ones only
+		uint8_t *data[k], *par[m];
+		for (unsigned int i=0; i<k ;++i)
+			data[i] = NULL;
+		for (unsigned int i=0; i<m ;++i)
+			par[i] = NULL;
+		for (const int *s = rain_decode_plan_sources (plan); *s >= 0 ;++s) {
+			if ((unsigned int)*s < k)
+				data[*s] = buf + (*s * enc.block_size);
+			else
+				par[*s - k] = parity[*s - k];
+		}
+		for (const int *t = rain_decode_plan_targets (plan); *t >= 0 ;++t)
+			data[*t] = malloc (enc.block_size);
+		rc = rain_decode_plan_apply (plan, &enc, data, par);
+		assert (rc != 0);
+		for (const int *t = rain_decode_plan_targets (plan); *t >= 0 ;++t) {
+			assert (0 == memcmp (data[*t], buf + (*t * enc.block_size),
+						enc.block_size));
+			free (data[*t]);
+		}
+		rain_decode_plan_free (plan);
+	}
+
+	// Not enough blocks
+	available[0] = 0;
+	available[1] = -1;
+	assert (NULL == rain_decode_plan_choose (&enc, available, NULL, 0.0));
+
+	for (unsigned int i=0; i<m ;++i)
+		free (parity[i]);
+	free (buf);
+}
+
+/* With the same fetch cost for all the blocks, only the subsets reading
+ * the fewest parity blocks are decoded */
+static void
+test_choose_timing (const char *algo, unsigned int k, unsigned int m)
+{
+	const unsigned int count = 100;
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding (&enc, 1*MiB, k, m, algo);
+	assert (rc != 0);
+	const unsigned int sum = k + m;
+
+	for (unsigned int lost=1; lost<=2 ;++lost) {
+		int available[sum + 1];
+		unsigned int nb = 0;
+		for (unsigned int i=lost; i<sum ;++i)
+			available[nb++] = i;
+		available[nb] = -1;
+
+		struct timespec pre, post;
+		clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &pre);
+		for (unsigned int i=0; i<count ;++i) {
+			struct rain_decode_plan_s *plan = rain_decode_plan_choose (&enc,
+					available, NULL, 1e-6);
+			assert (plan != NULL);
+			assert (rain_decode_plan_sources (plan)[k - lost] >= (int)k);
+			rain_decode_plan_free (plan);
+		}
+		clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &post);
+
+		size_t elapsed = _elapsed_msec (pre, post);
+		PRINTF ("CHOOSE %s %u+%u lost=%u %u calls in %lu ms\n",
+				algo, k, m, lost, count, elapsed);
+		// Less than 5 ms each
+		assert (elapsed < count * 5);
+	}
+}
+
+/* The sources added in any order give the same blocks as the plan */
+static void
+test_progressive (size_t length, const char *algo, unsigned int k,
+		unsigned int m, int flags)
+{
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding_ext (&enc, length, k, m, algo, flags);
+	assert (rc != 0);
+	const unsigned int sum = k + m;
+
+	uint8_t *buf = malloc (enc.padded_data_size);
+	randomize (buf, length);
+	memset (buf + length, 0, enc.padded_data_size - length);
+	uint8_t *blocks[sum];
+	for (unsigned int i=0; i<k ;++i)
+		blocks[i] = buf + (i * enc.block_size);
+	rc = rain_encode (buf, length, &enc, NULL, blocks + k);
+	assert (rc != 0);
+
+	for (unsigned int round=0; round<10 ;++round) {
+		// Up to m random erasures
+		int erasures[m + 1];
+		unsigned int nb = 0;
+		for (unsigned int i=0; i<sum && nb<m ;++i) {
+			if (random () % sum < m)
+				erasures[nb++] = i;
+		}
+		erasures[nb] = -1;
+		struct rain_decode_plan_s *plan = rain_decode_plan_create (&enc, erasures);
+		assert (plan != NULL);
+
+		uint8_t *targets[m];
+		for (unsigned int t=0; t<nb ;++t)
+			targets[t] = malloc (enc.block_size);
+		struct rain_progressive_s *dec = rain_progressive_create (plan,
+				&enc, targets);
+		assert (dec != NULL);
+
+		// The sources in a random order
+		int order[k];
+		memcpy (order, rain_decode_plan_sources (plan), k * sizeof(int));
+		for (unsigned int i=k-1; i>0 ;--i) {
+			unsigned int j = random () % (i + 1);
+			int tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+		}
+		for (unsigned int i=0; i<k ;++i) {
+			assert (!rain_progressive_complete (dec));
+			rc = rain_progressive_add (dec, order[i], blocks[order[i]]);
+			assert (rc != 0);
+		}
+		assert (rain_progressive_complete (dec));
+
+		// Twice the same source, or a block that is not a source
+		assert (!rain_progressive_add (dec, order[0], blocks[order[0]]));
+		if (nb > 0)
+			assert (!rain_progressive_add (dec, erasures[0], blocks[0]));
+
+		for (unsigned int t=0; t<nb ;++t) {
+			assert (0 == memcmp (targets[t], blocks[erasures[t]], enc.block_size));
+			free (targets[t]);
+		}
+		rain_progressive_free (dec);
+		rain_decode_plan_free (plan);
+	}
+
+	for (unsigned int i=0; i<m ;++i)
+		free (blocks[k + i]);
+	free (buf);
+}
+
+/* Same parity with zero extents skipped, whatever their layout */
+static void
+test_sparse (size_t length, const char *algo, unsigned int k, unsigned int m,
+		int flags)
+{
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding_ext (&enc, length, k, m, algo, flags);
+	assert (rc != 0);
+
+	uint8_t *buf = malloc (enc.padded_data_size);
+	uint8_t *data[k], *parity[m], *expected[m];
+	for (unsigned int i=0; i<k ;++i)
+		data[i] = buf + (i * enc.block_size);
+	for (unsigned int i=0; i<m ;++i) {
+		parity[i] = malloc (enc.block_size);
+		expected[i] = malloc (enc.block_size);
+	}
+
+	for (int pattern=0; pattern<4 ;++pattern) {
+		randomize (buf, length);
+		memset (buf + length, 0, enc.padded_data_size - length);
+		if (pattern == 0) {
+			memset (buf, 0, length);
+		} else if (pattern == 1) {
+			for (unsigned int i=0; i<k ;i+=2)
+				memset (data[i], 0, enc.block_size);
+		} else if (pattern == 2) {
+			// Zero extents of random sizes
+			for (size_t off=0; off<length ;) {
+				size_t len = 1 + random () % (4 * enc.strip_size);
+				len = MACRO_COND(len > length - off, length - off, len);
+				if (random () % 2)
+					memset (buf + off, 0, len);
+				off += len;
+			}
+		}
+
+		rc = rain_encode_noalloc (&enc, data, expected);
+		assert (rc != 0);
+		struct rain_sparse_stats_s st;
+		memset (&st, 0, sizeof(st));
+		rc = rain_encode_sparse (&enc, data, parity, &st);
+		assert (rc != 0);
+		for (unsigned int i=0; i<m ;++i)
+			assert (0 == memcmp (parity[i], expected[i], enc.block_size));
+
+		assert (st.bytes_scanned == enc.padded_data_size);
+		assert (st.bytes_skipped <= st.bytes_scanned);
+		if (pattern == 0) {
+			assert (st.bytes_skipped == st.bytes_scanned);
+			assert (st.stripes_skipped > 0);
+		}
+		if (pattern == 1 && k > 1)
+			assert (st.bytes_skipped >= ((k + 1) / 2) * enc.block_size);
+	}
+
+	for (unsigned int i=0; i<m ;++i) {
+		free (parity[i]);
+		free (expected[i]);
+	}
+	free (buf);
+}
+
+/* The fragments hold the blocks of rain_encode(), after their header */
+static void
+test_fused (size_t length, const char *algo, unsigned int k, unsigned int m,
+		int flags)
+{
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding_ext (&enc, length, k, m, algo, flags);
+	assert (rc != 0);
+
+	uint8_t *buf = malloc (enc.padded_data_size);
+	randomize (buf, length);
+	memset (buf + length, 0, enc.padded_data_size - length);
+	uint8_t *parity[m];
+	rc = rain_encode (buf, length, &enc, NULL, parity);
+	assert (rc != 0);
+
+	static const size_t headers[] = { 0, 13, 64 };
+	for (unsigned int h=0; h<3 ;++h) {
+		const size_t hs = headers[h];
+		uint8_t *fragments[k + m];
+		for (unsigned int i=0; i<k+m ;++i) {
+			fragments[i] = malloc (hs + enc.block_size);
+			memset (fragments[i], 0xA5, hs + enc.block_size);
+		}
+		rc = rain_encode_fused (buf, length, &enc, fragments, hs);
+		assert (rc != 0);
+		for (unsigned int i=0; i<k+m ;++i) {
+			for (size_t j=0; j<hs ;++j)
+				assert (fragments[i][j] == 0xA5);
+			const uint8_t *block = (i < k) ? buf + (i * enc.block_size) : parity[i - k];
+			assert (0 == memcmp (fragments[i] + hs, block, enc.block_size));
+			free (fragments[i]);
+		}
+	}
+
+	// More than the encoding was prepared for, the excess would be lost
+	uint8_t *fragments[k + m];
+	for (unsigned int i=0; i<k+m ;++i)
+		fragments[i] = malloc (enc.block_size);
+	uint8_t *more = malloc (length + 1);
+	randomize (more, length + 1);
+	errno = 0;
+	assert (!rain_encode_fused (more, length + 1, &enc, fragments, 0));
+	assert (errno == EINVAL);
+	free (more);
+	for (unsigned int i=0; i<k+m ;++i)
+		free (fragments[i]);
+
+	for (unsigned int i=0; i<m ;++i)
+		free (parity[i]);
+	free (buf);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -222,9 +759,77 @@ main(int argc, char **argv)
 			test_sizes_around (length, "crs", k, 4);
 	}
 
+	for (unsigned int k=2; k<8 ;++k)
+		test_layout_sweep ("liber8tion", k, 2);
+	test_layout_sweep ("crs", 10, 4);
+	test_layout_sweep ("crs_min", 6, 2);
+	test_layout_timing ("crs", 8, 4, 0);
+	test_layout_timing ("crs", 8, 4, LIBRAIN_TAIL_STRIPE);
+
 	for (int size = 1; size < 5555; size += 7) {
 		test_roundtrip (size, "crs", 6, 2);
 		test_roundtrip (size, "liber8tion", 6, 2);
+		test_roundtrip_flags (size, "crs", 6, 2, LIBRAIN_TAIL_STRIPE);
+		test_roundtrip_flags (size, "liber8tion", 6, 2, LIBRAIN_TAIL_STRIPE);
+	}
+	for (int size = 100000; size < 1000000; size += 77777) {
+		test_roundtrip_flags (size, "crs", 8, 4, LIBRAIN_TAIL_STRIPE);
+		test_roundtrip_flags (size, "crs_min", 10, 4, LIBRAIN_TAIL_STRIPE);
+	}
+
+	for (unsigned int k=2; k<=12 ;++k) {
+		for (unsigned int m=1; m<=4 ;++m)
+			test_xor_weight (k, m);
+	}
+	for (int size = 1; size < 200000; size += 7777) {
+		test_roundtrip (size, "crs_min", 6, 2);
+		test_roundtrip (size, "crs_min", 10, 4);
+	}
+
+	// Profiles with generated kernels (cf. RAIN_KERNELS)
+	for (int size = 1; size < 200000; size += 7777) {
+		test_roundtrip (size, "crs", 8, 4);
+		test_roundtrip (size, "crs", 10, 4);
+	}
+
+	// Scatter-gather input and output
+	for (int size = 0; size < 100000; size += 3333) {
+		test_iov (size, "crs", 6, 2, 0);
+		test_iov (size, "liber8tion", 5, 2, LIBRAIN_TAIL_STRIPE);
+		test_iov (size, "crs", 8, 4, 0);
+		test_iov (size, "crs", 8, 4, LIBRAIN_TAIL_STRIPE);
+		test_iov (size, "crs_min", 10, 4, LIBRAIN_TAIL_STRIPE);
+	}
+
+	// Cheapest sources
+	test_choose (100000, "crs", 6, 2);
+	test_choose (100000, "liber8tion", 7, 2);
+	test_choose (100000, "crs", 8, 4);
+	test_choose (100000, "crs_min", 10, 4);
+	test_choose_timing ("crs", 10, 4);
+	test_choose_timing ("crs", 12, 4);
+
+	// Progressive decoding
+	for (int size = 1; size < 300000; size += 33333) {
+		test_progressive (size, "crs", 6, 2, 0);
+		test_progressive (size, "liber8tion", 7, 2, LIBRAIN_TAIL_STRIPE);
+		test_progressive (size, "crs_min", 10, 4, LIBRAIN_TAIL_STRIPE);
+	}
+
+	// Sparse data
+	for (int size = 1; size < 1000000; size += 99999) {
+		test_sparse (size, "crs", 6, 2, 0);
+		test_sparse (size, "liber8tion", 7, 2, LIBRAIN_TAIL_STRIPE);
+		test_sparse (size, "crs", 8, 4, 0);
+		test_sparse (size, "crs_min", 10, 4, LIBRAIN_TAIL_STRIPE);
+	}
+
+	// Fused copy and encoding
+	for (int size = 0; size < 1000000; size += 99999) {
+		test_fused (size, "crs", 6, 2, 0);
+		test_fused (size, "liber8tion", 7, 2, LIBRAIN_TAIL_STRIPE);
+		test_fused (size, "crs", 8, 4, LIBRAIN_TAIL_STRIPE);
+		test_fused (size, "crs_min", 10, 4, 0);
 	}
 
 	// Benchmark the encoding throughput
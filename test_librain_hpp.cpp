@@ -0,0 +1,187 @@
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+#include "./librain.hpp"
+
+// The layout is known at compile time
+static_assert(rain::codec<rain::algo::crs, 8, 4>::w == 4, "");
+static_assert(rain::codec<rain::algo::liberation, 6, 2>::w == 8, "");
+static_assert(rain::codec<rain::algo::crs, 8, 4>::plan(0).block_size == 8 * 4 * 64 / 8, "");
+static_assert(rain::codec<rain::algo::crs, 8, 4>::plan(1 << 30).packet_size == 2048, "");
+static_assert(rain::codec<rain::algo::crs, 8, 4>::plan(100000, LIBRAIN_TAIL_STRIPE)
+		.padded_data_size - 100000 < 8 * 4 * LIBRAIN_TAIL_ALIGN, "");
+static_assert(!rain::valid_profile(rain::algo::liberation, 8, 2), "");
+static_assert(!rain::valid_profile(rain::algo::crs_min, 13, 4), "");
+
+static std::size_t allocated = 0;
+
+template <class T>
+struct counting_allocator
+{
+	using value_type = T;
+	counting_allocator() = default;
+	template <class U> counting_allocator(const counting_allocator<U>&) {}
+	T *allocate(std::size_t n) {
+		allocated += n * sizeof(T);
+		return static_cast<T*>(std::malloc(n * sizeof(T)));
+	}
+	void deallocate(T *p, std::size_t n) {
+		allocated -= n * sizeof(T);
+		std::free(p);
+	}
+	bool operator==(const counting_allocator&) const { return true; }
+	bool operator!=(const counting_allocator&) const { return false; }
+};
+
+static std::vector<std::uint8_t>
+_random (std::size_t length)
+{
+	std::vector<std::uint8_t> v(length);
+	for (auto &b : v)
+		b = std::rand() & 0xFF;
+	return v;
+}
+
+/* The constexpr layout is the one of rain_get_encoding_ext() */
+static void
+test_layout (rain::algo a, unsigned int k, unsigned int m, int flags)
+{
+	rain::dynamic_codec codec(a, k, m);
+	for (std::size_t length = 0; length < 8*1024*1024; length = length * 3 / 2 + 1) {
+		rain::encoding enc = codec.make_encoding(length, flags);
+		rain::layout l = codec.plan(length, flags);
+		assert (l.packet_size == enc.params().packet_size);
+		assert (l.tail_packet_size == enc.params().tail_packet_size);
+		assert (l.strip_size == enc.params().strip_size);
+		assert (l.block_size == enc.block_size());
+		assert (l.padded_data_size == enc.padded_data_size());
+	}
+}
+
+template <rain::algo A, unsigned int K, unsigned int M>
+static void
+test_codec (std::size_t length, int flags)
+{
+	using codec = rain::codec<A, K, M>;
+	auto object = _random(length);
+	{
+		auto frags = codec::encode(rain::span<const std::uint8_t>(object.data(),
+					object.size()), flags, counting_allocator<std::uint8_t>());
+		rain::encoding enc = codec::make_encoding(length, flags);
+		assert (allocated == (K + M) * enc.block_size());
+		assert (0 == std::memcmp(frags[0].data(), object.data(),
+					length < enc.block_size() ? length : enc.block_size()));
+
+		// Move-only, the ownership follows
+		auto moved = std::move(frags[K]);
+		assert (frags[K].empty() && moved.size() == enc.block_size());
+		frags[K] = std::move(moved);
+
+		// The parity computed again into the caller's blocks
+		std::vector<std::uint8_t> parity(M * enc.block_size());
+		std::array<rain::span<const std::uint8_t>, K> data;
+		std::array<rain::span<std::uint8_t>, M> out;
+		for (unsigned int i = 0; i < K; ++i)
+			data[i] = frags[i].bytes();
+		for (unsigned int i = 0; i < M; ++i)
+			out[i] = rain::span<std::uint8_t>(parity.data() + i * enc.block_size(),
+					enc.block_size());
+		codec::encode(enc, data, out);
+		for (unsigned int i = 0; i < M; ++i)
+			assert (0 == std::memcmp(out[i].data(), frags[K + i].data(),
+						enc.block_size()));
+
+		// Lose M blocks
+		for (unsigned int first = 0; first + M <= K + M; ++first) {
+			std::array<rain::span<const std::uint8_t>, K + M> blocks;
+			for (unsigned int i = 0; i < K + M; ++i) {
+				if (i < first || i >= first + M)
+					blocks[i] = frags[i].bytes();
+			}
+			std::vector<std::uint8_t> back(length);
+			codec::rehydrate(enc, blocks, rain::span<std::uint8_t>(back.data(),
+						back.size()));
+			assert (back == object);
+		}
+
+		// One block too many lost, only K-1 left
+		std::array<rain::span<const std::uint8_t>, K + M> blocks;
+		for (unsigned int i = M + 1; i < K + M; ++i)
+			blocks[i] = frags[i].bytes();
+		std::vector<std::uint8_t> back(length);
+		bool thrown = false;
+		try {
+			codec::rehydrate(enc, blocks, rain::span<std::uint8_t>(back.data(),
+						back.size()));
+		} catch (const std::system_error &e) {
+			thrown = (e.code().value() == EINVAL);
+		}
+		assert (thrown);
+
+		// A truncated block is not taken for a missing one
+		for (unsigned int i = 0; i < K + M; ++i)
+			blocks[i] = frags[i].bytes();
+		blocks[0] = rain::span<const std::uint8_t>(frags[0].data(),
+				enc.block_size() - 1);
+		thrown = false;
+		try {
+			codec::rehydrate(enc, blocks, rain::span<std::uint8_t>(back.data(),
+						back.size()));
+		} catch (const std::system_error &e) {
+			thrown = (e.code().value() == EINVAL);
+		}
+		assert (thrown);
+	}
+	assert (allocated == 0);
+}
+
+static void
+test_dynamic (rain::algo a, unsigned int k, unsigned int m, std::size_t length)
+{
+	rain::dynamic_codec codec(a, k, m);
+	auto object = _random(length);
+	auto frags = codec.encode(rain::span<const std::uint8_t>(object.data(),
+				object.size()));
+	assert (frags.size() == k + m);
+	rain::encoding enc = codec.make_encoding(length);
+
+	std::vector<rain::span<const std::uint8_t>> blocks(k + m);
+	for (unsigned int i = m; i < k + m; ++i)
+		blocks[i] = frags[i].bytes();
+	std::vector<std::uint8_t> back(length);
+	codec.rehydrate(enc, blocks, rain::span<std::uint8_t>(back.data(), back.size()));
+	assert (back == object);
+
+	// A profile librain refuses
+	bool thrown = false;
+	try {
+		rain::dynamic_codec bad(rain::algo::liberation, 9, 2);
+	} catch (const std::system_error &) {
+		thrown = true;
+	}
+	assert (thrown);
+}
+
+int
+main(int argc, char **argv)
+{
+	(void) argc, (void) argv;
+
+	test_layout (rain::algo::crs, 8, 4, 0);
+	test_layout (rain::algo::crs, 8, 4, LIBRAIN_TAIL_STRIPE);
+	test_layout (rain::algo::liberation, 6, 2, 0);
+	test_layout (rain::algo::crs_min, 10, 4, LIBRAIN_TAIL_STRIPE);
+
+	for (std::size_t length = 0; length < 300000; length += 77777) {
+		test_codec<rain::algo::crs, 8, 4> (length, 0);
+		test_codec<rain::algo::liberation, 6, 2> (length, LIBRAIN_TAIL_STRIPE);
+		test_codec<rain::algo::crs_min, 10, 4> (length, 0);
+		test_dynamic (rain::algo::crs, 6, 3, length);
+	}
+
+	std::printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,268 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "./librain.h"
+#include "./rain_fragment.h"
+#include "./test_utils.h"
+
+static char tmpdir[] = "/tmp/test_rain_fragment.XXXXXX";
+
+static void
+_path (char *path, size_t len, unsigned int index)
+{
+	snprintf (path, len, "%s/%u", tmpdir, index);
+}
+
+/* Encodes an object and writes all its fragments */
+static uint8_t *
+_write_object (size_t length, const char *algo, unsigned int k,
+		unsigned int m, int flags, const uint8_t *id)
+{
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding_ext (&enc, length, k, m, algo, flags);
+	assert (rc != 0);
+
+	uint8_t *buf = malloc (enc.padded_data_size);
+	randomize (buf, length);
+	memset (buf + length, 0, enc.padded_data_size - length);
+	uint8_t *parity[m];
+	rc = rain_encode (buf, length, &enc, NULL, parity);
+	assert (rc != 0);
+
+	char path[256];
+	for (unsigned int i=0; i<k+m ;++i) {
+		const uint8_t *block = (i < k) ? buf + (i * enc.block_size) : parity[i-k];
+		_path (path, sizeof(path), i);
+		rc = rain_fragment_write (path, &enc, i, id, block);
+		assert (rc != 0);
+	}
+	for (unsigned int i=0; i<m ;++i)
+		free (parity[i]);
+	return buf;
+}
+
+/* Any k fragments give the object back, in any order */
+static void
+test_roundtrip (size_t length, const char *algo, unsigned int k,
+		unsigned int m, int flags)
+{
+	uint8_t id[RAIN_FRAGMENT_ID];
+	randomize (id, sizeof(id));
+	uint8_t *buf = _write_object (length, algo, k, m, flags, id);
+
+	const unsigned int sum = k + m;
+	struct rain_fragment_s *all[sum];
+	char path[256];
+	for (unsigned int i=0; i<sum ;++i) {
+		_path (path, sizeof(path), i);
+		all[i] = rain_fragment_open (path, RAIN_FRAGMENT_VERIFY);
+		assert (all[i] != NULL);
+		assert (rain_fragment_index (all[i]) == i);
+		assert (0 == memcmp (rain_fragment_id (all[i]), id, sizeof(id)));
+		const struct rain_encoding_s *enc = rain_fragment_encoding (all[i]);
+		assert (enc->data_size == length);
+		assert (enc->k == k && enc->m == m);
+		if (i < k)
+			assert (0 == memcmp (rain_fragment_block (all[i]),
+						buf + i * enc->block_size, enc->block_size));
+	}
+
+	uint8_t *out = malloc (length + 1);
+	for (uint64_t mask=0; mask < (1ULL << sum) ;++mask) {
+		if (_count_bits (mask) != k)
+			continue;
+		// The chosen fragments, the last first
+		struct rain_fragment_s *chosen[k];
+		unsigned int n = 0;
+		for (int i=sum-1; i>=0 ;--i) {
+			if (mask & (1ULL << i))
+				chosen[n++] = all[i];
+		}
+		struct iovec iov = { out, length };
+		int rc = rain_fragment_rehydrate (chosen, k, NULL, &iov, 1);
+		assert (rc != 0);
+		assert (0 == memcmp (out, buf, length));
+
+		// One fragment short
+		rc = rain_fragment_rehydrate (chosen, k - 1, NULL, &iov, 1);
+		assert (rc == 0);
+	}
+
+	// The same fragment twice
+	struct rain_fragment_s *twice[2] = { all[0], all[0] };
+	struct rain_encoding_s enc;
+	uint8_t *data[k], *parity[m];
+	assert (!rain_fragment_blocks (twice, 2, &enc, data, parity));
+
+	for (unsigned int i=0; i<sum ;++i)
+		rain_fragment_close (all[i]);
+	free (out);
+	free (buf);
+}
+
+/* Corruptions are detected, the header always, the strips on demand */
+static void
+test_corruption (void)
+{
+	const size_t length = 100000;
+	uint8_t *buf = _write_object (length, "crs", 6, 2, LIBRAIN_TAIL_STRIPE, NULL);
+
+	char path[256];
+	_path (path, sizeof(path), 3);
+	FILE *f = fopen (path, "r");
+	assert (f != NULL);
+	fseek (f, 0, SEEK_END);
+	size_t size = ftell (f);
+	rewind (f);
+	uint8_t *frag = malloc (size);
+	assert (fread (frag, 1, size, f) == size);
+	fclose (f);
+
+	struct rain_fragment_s *fr = rain_fragment_open_buffer (frag, size, 0);
+	assert (fr != NULL);
+	const struct rain_encoding_s *enc = rain_fragment_encoding (fr);
+	assert (size == rain_fragment_size (enc));
+	const size_t hlen = rain_fragment_header_size (enc);
+	const unsigned int stripes = rain_fragment_stripes (fr);
+	assert (stripes == (enc->block_size + enc->strip_size - 1) / enc->strip_size);
+	for (unsigned int s=0; s<stripes ;++s)
+		assert (rain_fragment_verify_stripe (fr, s));
+	rain_fragment_close (fr);
+
+	// A flipped bit in the last strip
+	frag[size - 1] ^= 0x10;
+	fr = rain_fragment_open_buffer (frag, size, 0);
+	assert (fr != NULL);
+	for (unsigned int s=0; s<stripes-1 ;++s)
+		assert (rain_fragment_verify_stripe (fr, s));
+	errno = 0;
+	assert (!rain_fragment_verify_stripe (fr, stripes - 1));
+	assert (errno == EBADMSG);
+	rain_fragment_close (fr);
+	errno = 0;
+	assert (NULL == rain_fragment_open_buffer (frag, size, RAIN_FRAGMENT_VERIFY));
+	assert (errno == EBADMSG);
+	frag[size - 1] ^= 0x10;
+
+	// A flipped bit in the header or in the stripe index
+	for (size_t off=0; off<hlen ;off+=7) {
+		frag[off] ^= 0x01;
+		assert (NULL == rain_fragment_open_buffer (frag, size, 0));
+		frag[off] ^= 0x01;
+	}
+
+	// A truncated fragment
+	assert (NULL == rain_fragment_open_buffer (frag, size - 1, 0));
+	assert (NULL == rain_fragment_open_buffer (frag, 10, 0));
+
+	free (frag);
+	free (buf);
+}
+
+/* Fragments of distinct objects are not mixed */
+static void
+test_mixed_objects (void)
+{
+	uint8_t id0[RAIN_FRAGMENT_ID], id1[RAIN_FRAGMENT_ID];
+	memset (id0, 0, sizeof(id0));
+	memset (id1, 1, sizeof(id1));
+	char path[256];
+
+	uint8_t *buf = _write_object (5000, "crs", 4, 2, 0, id0);
+	_path (path, sizeof(path), 0);
+	struct rain_fragment_s *a = rain_fragment_open (path, 0);
+	free (buf);
+
+	buf = _write_object (5000, "crs", 4, 2, 0, id1);
+	_path (path, sizeof(path), 1);
+	struct rain_fragment_s *b = rain_fragment_open (path, 0);
+	free (buf);
+
+	buf = _write_object (5001, "crs", 4, 2, 0, id0);
+	_path (path, sizeof(path), 2);
+	struct rain_fragment_s *c = rain_fragment_open (path, 0);
+	free (buf);
+
+	assert (a && b && c);
+	struct rain_encoding_s enc;
+	uint8_t *data[4], *parity[2];
+	struct rain_fragment_s *ab[2] = { a, b }, *ac[2] = { a, c };
+	assert (!rain_fragment_blocks (ab, 2, &enc, data, parity));
+	assert (!rain_fragment_blocks (ac, 2, &enc, data, parity));
+	rain_fragment_close (a);
+	rain_fragment_close (b);
+	rain_fragment_close (c);
+}
+
+/* Well-formed fragments of profiles no decoding supports are refused */
+static void
+test_invalid_profiles (void)
+{
+	const unsigned int profiles[][2] = { {1000000, 2}, {14, 4}, {60, 8} };
+	char path[256];
+	_path (path, sizeof(path), 0);
+	for (unsigned int i=0; i<3 ;++i) {
+		struct rain_encoding_s enc;
+		int rc = rain_get_encoding_ext (&enc, 1000, profiles[i][0],
+				profiles[i][1], "crs", 0);
+		assert (rc != 0);
+		uint8_t *block = calloc (1, enc.block_size);
+		rc = rain_fragment_write (path, &enc, 0, NULL, block);
+		assert (rc != 0);
+		free (block);
+
+		errno = 0;
+		assert (NULL == rain_fragment_open (path, 0));
+		assert (errno == EINVAL);
+
+		FILE *f = fopen (path, "r");
+		assert (f != NULL);
+		fseek (f, 0, SEEK_END);
+		size_t size = ftell (f);
+		rewind (f);
+		uint8_t *frag = malloc (size);
+		assert (fread (frag, 1, size, f) == size);
+		fclose (f);
+		errno = 0;
+		assert (NULL == rain_fragment_open_buffer (frag, size, 0));
+		assert (errno == EINVAL);
+		free (frag);
+	}
+}
+
+static void
+_cleanup (void)
+{
+	char path[256];
+	for (unsigned int i=0; i<64 ;++i) {
+		_path (path, sizeof(path), i);
+		unlink (path);
+	}
+	rmdir (tmpdir);
+}
+
+int
+main(int argc, char **argv)
+{
+	(void) argc, (void) argv;
+
+	// Known CRC32C check value
+	assert (rain_crc32c (0, (const uint8_t*)"123456789", 9) == 0xE3069283);
+
+	assert (mkdtemp (tmpdir) != NULL);
+	atexit (_cleanup);
+
+	for (size_t length = 0; length < 300000; length += 59999) {
+		test_roundtrip (length, "crs", 6, 2, 0);
+		test_roundtrip (length, "liber8tion", 5, 2, LIBRAIN_TAIL_STRIPE);
+		test_roundtrip (length, "crs_min", 8, 3, LIBRAIN_TAIL_STRIPE);
+	}
+	test_roundtrip (3*MiB + 17, "crs", 8, 4, 0);
+	test_corruption ();
+	test_mixed_objects ();
+	test_invalid_profiles ();
+
+	return 0;
+}
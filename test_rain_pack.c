@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "./librain.h"
+#include "./rain_pack.h"
+#include "./test_utils.h"
+
+struct object_s
+{
+	uint64_t id;
+	uint8_t *buf;
+	size_t len;
+};
+
+static void
+_check_all (struct rain_encoding_s *enc, uint8_t **blocks,
+		struct object_s *objects, unsigned int count)
+{
+	for (unsigned int i=0; i<count ;++i) {
+		uint8_t *out = NULL;
+		size_t len = 0;
+		int rc = rain_pack_extract (enc, blocks, objects[i].id, NULL, &out, &len);
+		assert (rc != 0);
+		assert (len == objects[i].len);
+		assert (0 == memcmp (out, objects[i].buf, len));
+		free (out);
+	}
+}
+
+static void
+test_pack (const char *algo, unsigned int k, unsigned int m, int flags,
+		size_t capacity, size_t max_object)
+{
+	struct rain_pack_s *pack = rain_pack_create (algo, k, m, flags, capacity, NULL);
+	assert (pack != NULL);
+
+	// Fill the pack, in no particular order of ids
+	unsigned int count = 0, max = 1024;
+	struct object_s *objects = calloc (max, sizeof(struct object_s));
+	size_t alone = 0, payload = 0;
+	for (;;) {
+		struct object_s o;
+		o.id = (count * 2654435761ULL) ^ 0xABCDEF;
+		o.len = random () % (max_object + 1);
+		o.buf = malloc (o.len + 1);
+		randomize (o.buf, o.len);
+		if (!rain_pack_add (pack, o.id, o.buf, o.len)) {
+			assert (errno == ENOSPC);
+			free (o.buf);
+			break;
+		}
+		if (count >= max) {
+			max *= 2;
+			objects = realloc (objects, max * sizeof(struct object_s));
+		}
+		objects[count++] = o;
+
+		// The same object encoded alone
+		struct rain_encoding_s enc;
+		int rc = rain_get_encoding_ext (&enc, MACRO_COND(o.len > 0, o.len, 1),
+				k, m, algo, flags);
+		assert (rc != 0);
+		alone += (k + m) * enc.block_size;
+		payload += o.len;
+	}
+	assert (count > 0);
+	assert (rain_pack_count (pack) == count);
+	assert (rain_pack_size (pack) <= capacity);
+
+	// Already in the pack
+	assert (!rain_pack_add (pack, objects[0].id, NULL, 0));
+	assert (errno == EEXIST || errno == ENOSPC);
+
+	struct rain_encoding_s enc;
+	uint8_t *data = NULL, *parity[m];
+	int rc = rain_pack_seal (pack, &enc, &data, parity);
+	assert (rc != 0);
+	assert (rain_pack_count (pack) == 0);
+	const size_t packed = (k + m) * enc.block_size;
+	PRINTF ("PACK %s %u+%u objects=%u payload=%lu packed=%lu alone=%lu\n",
+			algo, k, m, count, payload, packed, alone);
+	assert (packed < alone);
+
+	uint8_t *blocks[k + m];
+	for (unsigned int i=0; i<k ;++i)
+		blocks[i] = data + (i * enc.block_size);
+	for (unsigned int i=0; i<m ;++i)
+		blocks[k + i] = parity[i];
+	_check_all (&enc, blocks, objects, count);
+
+	// Unknown object
+	uint8_t *out = NULL;
+	size_t len = 0;
+	assert (!rain_pack_extract (&enc, blocks, 42, NULL, &out, &len));
+	assert (errno == ENOENT);
+
+	// Degraded reads, any m blocks missing
+	const unsigned int sum = k + m;
+	for (unsigned int round=0; round<4 ;++round) {
+		uint8_t *degraded[sum];
+		memcpy (degraded, blocks, sizeof(degraded));
+		for (unsigned int lost=0; lost<m ;) {
+			unsigned int i = random () % sum;
+			if (degraded[i]) {
+				degraded[i] = NULL;
+				lost ++;
+			}
+		}
+		_check_all (&enc, degraded, objects, count);
+	}
+
+	// Too many missing
+	uint8_t *degraded[sum];
+	memcpy (degraded, blocks, sizeof(degraded));
+	for (unsigned int i=0; i<=m ;++i)
+		degraded[i] = NULL;
+	assert (!rain_pack_extract (&enc, degraded, objects[0].id, NULL, &out, &len));
+	assert (errno == EINVAL);
+
+	// The pack is reusable, and an empty one is valid
+	rc = rain_pack_add (pack, 7, objects[0].buf, objects[0].len);
+	assert (rc != 0);
+	uint8_t *data2 = NULL, *parity2[m];
+	rc = rain_pack_seal (pack, &enc, &data2, parity2);
+	assert (rc != 0);
+	free (data2);
+	for (unsigned int i=0; i<m ;++i)
+		free (parity2[i]);
+	rc = rain_pack_seal (pack, &enc, &data2, parity2);
+	assert (rc != 0);
+	for (unsigned int i=0; i<k ;++i)
+		blocks[i] = data2 + (i * enc.block_size);
+	for (unsigned int i=0; i<m ;++i)
+		blocks[k + i] = parity2[i];
+	assert (!rain_pack_extract (&enc, blocks, 7, NULL, &out, &len));
+	assert (errno == ENOENT);
+	free (data2);
+	for (unsigned int i=0; i<m ;++i)
+		free (parity2[i]);
+
+	for (unsigned int i=0; i<count ;++i)
+		free (objects[i].buf);
+	free (objects);
+	free (data);
+	for (unsigned int i=0; i<m ;++i)
+		free (parity[i]);
+	rain_pack_destroy (pack);
+}
+
+static void
+test_limits (void)
+{
+	assert (rain_pack_create ("liber8tion", 9, 2, 0, MiB, NULL) == NULL);
+	assert (errno == EINVAL);
+
+	struct rain_pack_s *pack = rain_pack_create ("crs", 6, 2, 0, 1000, NULL);
+	assert (pack != NULL);
+	uint8_t buf[1000];
+	memset (buf, 0, sizeof(buf));
+	assert (!rain_pack_add (pack, 1, buf, 1000 - RAIN_PACK_HEADER));
+	assert (errno == ENOSPC);
+	int rc = rain_pack_add (pack, 1, buf, 1000 - RAIN_PACK_HEADER - RAIN_PACK_ENTRY);
+	assert (rc != 0);
+	assert (rain_pack_size (pack) == 1000);
+	assert (!rain_pack_add (pack, 2, buf, 0));
+	assert (errno == ENOSPC);
+	rain_pack_destroy (pack);
+}
+
+int
+main(int argc, char **argv)
+{
+	(void) argc, (void) argv;
+
+	test_limits ();
+	test_pack ("crs", 6, 2, 0, 256*kiB, 4*kiB);
+	test_pack ("liber8tion", 6, 2, LIBRAIN_TAIL_STRIPE, 100*kiB, 1*kiB);
+	test_pack ("crs", 8, 4, LIBRAIN_TAIL_STRIPE, 1*MiB, 4*kiB);
+	test_pack ("crs_min", 10, 4, 0, 3*MiB, 16*kiB);
+
+	return 0;
+}
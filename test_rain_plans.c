@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "./librain.h"
+#include "./rain_plans.h"
+#include "./test_utils.h"
+
+static char path[] = "/tmp/test_rain_plans.XXXXXX";
+
+static struct rain_profile_s profiles[] = {
+	{"crs", 6, 2},
+	{"liber8tion", 6, 2},
+	{"crs", 8, 4},
+	{"crs_min", 10, 4},
+};
+
+static unsigned int
+_nb_patterns (unsigned int k, unsigned int m)
+{
+	unsigned int count = 0;
+	for (uint64_t mask=1; mask < (1ULL << (k + m)) ;++mask) {
+		if (_count_bits(mask) <= m)
+			count ++;
+	}
+	return count;
+}
+
+/* A few bytes of the file changed in place */
+static void
+_corrupt (off_t offset)
+{
+	int fd = open (path, O_RDWR);
+	assert (fd >= 0);
+	uint8_t b;
+	ssize_t r = pread (fd, &b, 1, offset);
+	assert (r == 1);
+	b ^= 0x5A;
+	r = pwrite (fd, &b, 1, offset);
+	assert (r == 1);
+	close (fd);
+}
+
+static void
+_same_plans (const struct rain_decode_plan_s *p0,
+		const struct rain_decode_plan_s *p1)
+{
+	size_t count = rain_decode_plan_export (p0, NULL);
+	assert (count == rain_decode_plan_export (p1, NULL));
+	int *e0 = calloc (count, sizeof(int)), *e1 = calloc (count, sizeof(int));
+	rain_decode_plan_export (p0, e0);
+	rain_decode_plan_export (p1, e1);
+	assert (0 == memcmp (e0, e1, count * sizeof(int)));
+	free (e0);
+	free (e1);
+	assert (rain_decode_plan_operations (p0) == rain_decode_plan_operations (p1));
+}
+
+/* Each stored plan is the one that would be computed, and rebuilds */
+static void
+test_lookup (struct rain_plans_s *plans, size_t length, const char *algo,
+		unsigned int k, unsigned int m)
+{
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding (&enc, length, k, m, algo);
+	assert (rc != 0);
+	uint8_t *buf = malloc (enc.padded_data_size);
+	randomize (buf, length);
+	memset (buf + length, 0, enc.padded_data_size - length);
+	uint8_t *parity[m];
+	rc = rain_encode (buf, length, &enc, NULL, parity);
+	assert (rc != 0);
+
+	uint8_t *out = malloc ((k + m) * enc.block_size);
+	const unsigned int sum = k + m;
+	for (uint64_t mask=1; mask < (1ULL << sum) ;++mask) {
+		if (_count_bits(mask) > m)
+			continue;
+		int erasures[65];
+		unsigned int n = 0;
+		for (unsigned int i=0; i<sum ;++i) {
+			if (mask & (1ULL << i))
+				erasures[n++] = i;
+		}
+		erasures[n] = -1;
+
+		struct rain_decode_plan_s *stored = rain_plans_lookup (plans, &enc, erasures);
+		assert (stored != NULL);
+		struct rain_decode_plan_s *built = rain_decode_plan_create (&enc, erasures);
+		assert (built != NULL);
+		_same_plans (stored, built);
+		rain_decode_plan_free (built);
+
+		uint8_t *data[k], *par[m];
+		for (unsigned int i=0; i<sum ;++i) {
+			uint8_t *b = (mask & (1ULL << i)) ? out + (i * enc.block_size)
+				: (i < k ? buf + (i * enc.block_size) : parity[i - k]);
+			if (i < k)
+				data[i] = b;
+			else
+				par[i - k] = b;
+		}
+		rc = rain_decode_plan_apply (stored, &enc, data, par);
+		assert (rc != 0);
+		for (int *e = erasures; *e >= 0 ;++e) {
+			const uint8_t *orig = (*e < (int)k) ? buf + (*e * enc.block_size)
+				: parity[*e - k];
+			assert (0 == memcmp (out + (*e * enc.block_size), orig, enc.block_size));
+		}
+		rain_decode_plan_free (stored);
+	}
+
+	// The order of the erasures does not matter
+	int erasures[3] = { 2, 0, -1 };
+	struct rain_decode_plan_s *plan = rain_plans_lookup (plans, &enc, erasures);
+	assert (plan != NULL);
+	assert (rain_decode_plan_targets (plan)[0] == 0);
+	assert (rain_decode_plan_targets (plan)[1] == 2);
+	rain_decode_plan_free (plan);
+
+	for (unsigned int i=0; i<m ;++i)
+		free (parity[i]);
+	free (out);
+	free (buf);
+}
+
+static void
+test_fallback (struct rain_plans_s *plans)
+{
+	struct rain_encoding_s enc;
+	int erasures[2] = { 1, -1 };
+	int rc = rain_get_encoding (&enc, 100000, 7, 3, "crs");
+	assert (rc != 0);
+
+	// Not stored, computed
+	errno = 0;
+	assert (rain_plans_lookup (plans, &enc, erasures) == NULL);
+	assert (errno == ENOENT);
+	struct rain_decode_plan_s *plan = rain_plans_get (plans, &enc, erasures);
+	assert (plan != NULL);
+	rain_decode_plan_free (plan);
+	plan = rain_plans_get (NULL, &enc, erasures);
+	assert (plan != NULL);
+	rain_decode_plan_free (plan);
+
+	// Invalid patterns
+	int dup[3] = { 1, 1, -1 };
+	rc = rain_get_encoding (&enc, 100000, 6, 2, "crs");
+	assert (rc != 0);
+	assert (rain_plans_lookup (plans, &enc, dup) == NULL);
+	assert (errno == EINVAL);
+	int many[4] = { 0, 1, 2, -1 };
+	assert (rain_plans_get (plans, &enc, many) == NULL);
+}
+
+/* The exported form is checked before being used */
+static void
+test_import (void)
+{
+	struct rain_encoding_s enc, other;
+	int rc = rain_get_encoding (&enc, 100000, 8, 4, "crs");
+	assert (rc != 0);
+	rc = rain_get_encoding (&other, 100000, 8, 4, "crs_min");
+	assert (rc != 0);
+	int erasures[3] = { 3, 9, -1 };
+	struct rain_decode_plan_s *plan = rain_decode_plan_create (&enc, erasures);
+	assert (plan != NULL);
+	size_t count = rain_decode_plan_export (plan, NULL);
+	int *in = malloc (count * sizeof(int));
+	rain_decode_plan_export (plan, in);
+
+	struct rain_decode_plan_s *copy = rain_decode_plan_import (&enc, in, count);
+	assert (copy != NULL);
+	_same_plans (plan, copy);
+	rain_decode_plan_free (copy);
+
+	assert (!rain_decode_plan_import (&enc, in, count - 1) && errno == EINVAL);
+	assert (!rain_decode_plan_import (&other, in, count) && errno == EINVAL);
+	in[6] = in[7]; // a source twice
+	assert (!rain_decode_plan_import (&enc, in, count) && errno == EINVAL);
+	rain_decode_plan_export (plan, in);
+	in[count - 8] = 8 + 2; // an operation writing out of the targets
+	assert (!rain_decode_plan_import (&enc, in, count) && errno == EINVAL);
+
+	free (in);
+	rain_decode_plan_free (plan);
+}
+
+static void
+test_corruption (void)
+{
+	struct rain_encoding_s enc;
+	int rc = rain_get_encoding (&enc, 100000, 6, 2, "crs");
+	assert (rc != 0);
+	int erasures[2] = { 0, -1 };
+
+	// A damaged plan is not used, it is computed instead
+	rc = rain_plans_save (path, profiles, 1);
+	assert (rc != 0);
+	struct rain_plans_s *plans = rain_plans_open (path);
+	assert (plans != NULL);
+	struct rain_decode_plan_s *plan = rain_plans_lookup (plans, &enc, erasures);
+	assert (plan != NULL);
+	rain_decode_plan_free (plan);
+	rain_plans_close (plans);
+
+	struct stat st;
+	rc = stat (path, &st);
+	assert (rc == 0);
+	_corrupt (st.st_size - 16);
+	plans = rain_plans_open (path);
+	assert (plans != NULL);
+	unsigned int bad = 0;
+	for (uint64_t mask=1; mask < 256 ;++mask) {
+		if (_count_bits(mask) > 2)
+			continue;
+		int e[3], n = 0;
+		for (int i=0; i<8 ;++i) {
+			if (mask & (1 << i))
+				e[n++] = i;
+		}
+		e[n] = -1;
+		plan = rain_plans_lookup (plans, &enc, e);
+		if (!plan) {
+			assert (errno == EBADMSG);
+			bad ++;
+			plan = rain_plans_get (plans, &enc, e);
+			assert (plan != NULL);
+		}
+		rain_decode_plan_free (plan);
+	}
+	assert (bad == 1);
+	rain_plans_close (plans);
+
+	// A damaged header or index, the file is refused
+	rc = rain_plans_save (path, profiles, 1);
+	assert (rc != 0);
+	_corrupt (100);
+	assert (rain_plans_open (path) == NULL);
+	assert (errno == EBADMSG);
+
+	// Another version
+	rc = rain_plans_save (path, profiles, 1);
+	assert (rc != 0);
+	_corrupt (8);
+	assert (rain_plans_open (path) == NULL);
+	assert (errno == EINVAL);
+
+	// Truncated
+	rc = rain_plans_save (path, profiles, 1);
+	assert (rc != 0);
+	rc = truncate (path, 4096);
+	assert (rc == 0);
+	assert (rain_plans_open (path) == NULL);
+	assert (errno == EBADMSG);
+
+	// Invalid and duplicated profiles are refused
+	struct rain_profile_s invalid[] = { {"liber8tion", 9, 2} };
+	assert (!rain_plans_save (path, invalid, 1) && errno == EINVAL);
+	struct rain_profile_s twice[] = { {"crs", 6, 2}, {"crs", 6, 2} };
+	assert (!rain_plans_save (path, twice, 2) && errno == EINVAL);
+}
+
+int
+main(int argc, char **argv)
+{
+	(void) argc, (void) argv;
+
+	int fd = mkstemp (path);
+	assert (fd >= 0);
+	close (fd);
+
+	const unsigned int nb = sizeof(profiles) / sizeof(profiles[0]);
+	struct timespec t0, t1, t2;
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+	int rc = rain_plans_save (path, profiles, nb);
+	assert (rc != 0);
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	struct rain_plans_s *plans = rain_plans_open (path);
+	assert (plans != NULL);
+	clock_gettime (CLOCK_MONOTONIC, &t2);
+	PRINTF ("PLANS saved in %fs, opened in %fs\n",
+			(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9,
+			(t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9);
+
+	unsigned int expected = 0;
+	for (unsigned int i=0; i<nb ;++i)
+		expected += _nb_patterns (profiles[i].k, profiles[i].m);
+	assert (rain_plans_count (plans) == expected);
+
+	test_lookup (plans, 12345, "crs", 6, 2);
+	test_lookup (plans, 100000, "liber8tion", 6, 2);
+	test_lookup (plans, 54321, "crs", 8, 4);
+	test_lookup (plans, 3000, "crs_min", 10, 4);
+	test_fallback (plans);
+	rain_plans_close (plans);
+
+	test_import ();
+	test_corruption ();
+
+	unlink (path);
+	return 0;
+}
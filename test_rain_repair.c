@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "./librain.h"
+#include "./rain_repair.h"
+#include "./test_utils.h"
+
+struct object_s
+{
+	struct rain_encoding_s enc;
+	uint8_t *buf;
+	uint8_t *blocks[64];
+	uint8_t *rebuilt[64];
+	int erasures[65];
+	int unavailable; /**< a source that cannot be fetched, or -1 */
+	int ok;
+	unsigned int done;
+};
+
+static int
+_fetch (void *udata, unsigned int index, uint8_t *buf, size_t len)
+{
+	struct object_s *o = udata;
+	assert (len == o->enc.block_size);
+	for (int *e = o->erasures; *e >= 0 ;++e)
+		assert ((unsigned int)*e != index);
+	if ((int)index == o->unavailable)
+		return 0;
+	memcpy (buf, o->blocks[index], len);
+	return 1;
+}
+
+static int
+_store (void *udata, unsigned int index, const uint8_t *buf, size_t len)
+{
+	struct object_s *o = udata;
+	assert (len == o->enc.block_size);
+	assert (o->rebuilt[index] == NULL);
+	o->rebuilt[index] = malloc (len);
+	memcpy (o->rebuilt[index], buf, len);
+	return 1;
+}
+
+static void
+_done (void *udata, int ok)
+{
+	struct object_s *o = udata;
+	o->ok = ok;
+	o->done ++;
+}
+
+static void
+object_init (struct object_s *o, size_t length, const char *algo,
+		unsigned int k, unsigned int m)
+{
+	memset (o, 0, sizeof(*o));
+	o->unavailable = -1;
+	int rc = rain_get_encoding (&o->enc, length, k, m, algo);
+	assert (rc != 0);
+
+	rc = posix_memalign ((void**)&o->buf, sizeof(long), o->enc.padded_data_size);
+	assert (rc == 0 && o->buf != NULL);
+	randomize (o->buf, length);
+	memset (o->buf + length, 0, o->enc.padded_data_size - length);
+	for (unsigned int i=0; i<k ;++i)
+		o->blocks[i] = o->buf + (i * o->enc.block_size);
+	rc = rain_encode (o->buf, length, &o->enc, NULL, o->blocks + k);
+	assert (rc != 0);
+}
+
+static void
+object_check_and_clean (struct object_s *o)
+{
+	assert (o->done == 1);
+	assert (o->ok);
+	for (int *e = o->erasures; *e >= 0 ;++e) {
+		assert (o->rebuilt[*e] != NULL);
+		assert (0 == memcmp (o->rebuilt[*e], o->blocks[*e], o->enc.block_size));
+		free (o->rebuilt[*e]);
+		o->rebuilt[*e] = NULL;
+	}
+}
+
+static void
+object_fini (struct object_s *o)
+{
+	for (unsigned int i=0; i<o->enc.m ;++i)
+		free (o->blocks[o->enc.k + i]);
+	free (o->buf);
+}
+
+static void
+_submit (struct rain_repair_s *rs, struct object_s *o, int priority)
+{
+	struct rain_repair_job_s job;
+	memset (&job, 0, sizeof(job));
+	job.encoding = o->enc;
+	job.erasures = o->erasures;
+	job.priority = priority;
+	job.fetch = _fetch;
+	job.store = _store;
+	job.done = _done;
+	job.udata = o;
+	o->done = 0;
+	o->ok = 0;
+	int rc = rain_repair_submit (rs, &job);
+	assert (rc != 0);
+}
+
+/* Each pattern of at most m erasures, submitted for several objects */
+static void
+test_all_patterns (size_t length, const char *algo, unsigned int k,
+		unsigned int m, unsigned int workers, struct rain_plans_s *plans)
+{
+	const unsigned int sum = k + m, nb_objects = 3;
+	struct rain_repair_config_s cfg;
+	memset (&cfg, 0, sizeof(cfg));
+	cfg.workers = workers;
+	cfg.plans = plans;
+	struct rain_repair_s *rs = rain_repair_create (&cfg);
+	assert (rs != NULL);
+
+	unsigned int nb_patterns = 0;
+	for (uint64_t mask=1; mask < (1ULL << sum) ;++mask) {
+		if (_count_bits(mask) <= m)
+			nb_patterns ++;
+	}
+
+	struct object_s *objects = calloc (nb_patterns * nb_objects, sizeof(struct object_s));
+	struct object_s *o = objects;
+	for (uint64_t mask=1; mask < (1ULL << sum) ;++mask) {
+		if (_count_bits(mask) > m)
+			continue;
+		for (unsigned int j=0; j<nb_objects ;++j, ++o) {
+			object_init (o, length + j, algo, k, m);
+			unsigned int n = 0;
+			for (unsigned int i=0; i<sum ;++i) {
+				if (mask & (1ULL << i))
+					o->erasures[n++] = i;
+			}
+			o->erasures[n] = -1;
+			_submit (rs, o, (int)(mask % 3));
+		}
+	}
+	rain_repair_wait (rs);
+
+	struct rain_repair_stats_s st;
+	rain_repair_get_stats (rs, &st);
+	PRINTF ("REPAIR %s %u+%u workers=%u jobs=%lu plans=%lu shared=%lu %f\n",
+			algo, k, m, workers, st.jobs_done, st.plans_built,
+			st.plans_shared, st.throughput);
+	assert (st.jobs_submitted == nb_patterns * nb_objects);
+	assert (st.jobs_done == st.jobs_submitted);
+	assert (st.jobs_failed == 0);
+	assert (st.plans_built == nb_patterns);
+	assert (st.plans_loaded == (plans ? nb_patterns : 0));
+	assert (st.plans_built + st.plans_shared == st.jobs_done);
+
+	for (unsigned int i=0; i<nb_patterns * nb_objects ;++i) {
+		object_check_and_clean (objects + i);
+		object_fini (objects + i);
+	}
+	free (objects);
+	rain_repair_destroy (rs);
+}
+
+/* A source that cannot be fetched is replaced by another one */
+static void
+test_unavailable_source (const char *algo, unsigned int k, unsigned int m)
+{
+	struct rain_repair_s *rs = rain_repair_create (NULL);
+	assert (rs != NULL);
+
+	struct object_s o;
+	object_init (&o, 12345, algo, k, m);
+	o.erasures[0] = 1;
+	o.erasures[1] = -1;
+	o.unavailable = 0;
+	_submit (rs, &o, 0);
+	rain_repair_wait (rs);
+	object_check_and_clean (&o);
+
+	// Too many blocks lost, the job fails
+	if (m == 2) {
+		o.erasures[0] = 1;
+		o.erasures[1] = 2;
+		o.erasures[2] = -1;
+		_submit (rs, &o, 0);
+		rain_repair_wait (rs);
+		assert (o.done == 1 && !o.ok);
+	}
+
+	object_fini (&o);
+	rain_repair_destroy (rs);
+}
+
+static void
+test_budgets (const char *algo, unsigned int k, unsigned int m)
+{
+	const unsigned int nb_objects = 32;
+	struct object_s objects[nb_objects];
+	for (unsigned int i=0; i<nb_objects ;++i) {
+		object_init (objects + i, 256*kiB, algo, k, m);
+		objects[i].erasures[0] = i % (k + m);
+		objects[i].erasures[1] = -1;
+	}
+	const size_t per_job = (k + 1) * objects[0].enc.block_size;
+
+	struct rain_repair_config_s cfg;
+	memset (&cfg, 0, sizeof(cfg));
+	cfg.workers = 8;
+	cfg.memory_budget = 3 * per_job;
+	cfg.bandwidth_budget = 64 * MiB;
+	struct rain_repair_s *rs = rain_repair_create (&cfg);
+	assert (rs != NULL);
+
+	for (unsigned int i=0; i<nb_objects ;++i)
+		_submit (rs, objects + i, 0);
+	rain_repair_wait (rs);
+
+	struct rain_repair_stats_s st;
+	rain_repair_get_stats (rs, &st);
+	PRINTF ("BUDGET %s %u+%u peak=%lu read=%lu elapsed=%f\n", algo, k, m,
+			st.memory_peak, st.bytes_read, st.elapsed);
+	assert (st.jobs_done == nb_objects);
+	assert (st.memory_peak <= cfg.memory_budget);
+	assert (st.bytes_read == nb_objects * k * objects[0].enc.block_size);
+	// The first fetch is free, all the others wait for their slot
+	double expected = (double)(st.bytes_read - objects[0].enc.block_size)
+		/ (double)cfg.bandwidth_budget;
+	assert (st.elapsed >= expected);
+
+	rain_repair_destroy (rs);
+	for (unsigned int i=0; i<nb_objects ;++i) {
+		object_check_and_clean (objects + i);
+		object_fini (objects + i);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	(void) argc, (void) argv;
+
+	test_all_patterns (3000, "crs", 6, 2, 1, NULL);
+	test_all_patterns (3000, "crs", 6, 2, 4, NULL);
+	test_all_patterns (3000, "liber8tion", 6, 2, 4, NULL);
+	test_all_patterns (70000, "crs", 8, 4, 8, NULL);
+	test_all_patterns (3000, "crs_min", 10, 4, 8, NULL);
+	test_all_patterns (3000, "crs_min", 4, 4, 2, NULL);
+
+	// Same with all the plans precomputed
+	char path[] = "/tmp/test_rain_repair.XXXXXX";
+	int fd = mkstemp (path);
+	assert (fd >= 0);
+	close (fd);
+	struct rain_profile_s profiles[] = {
+		{"crs", 8, 4}, {"liber8tion", 6, 2}, {"crs_min", 10, 4},
+	};
+	int rc = rain_plans_save (path, profiles, 3);
+	assert (rc != 0);
+	struct rain_plans_s *plans = rain_plans_open (path);
+	assert (plans != NULL);
+	test_all_patterns (70000, "crs", 8, 4, 8, plans);
+	test_all_patterns (3000, "liber8tion", 6, 2, 4, plans);
+	test_all_patterns (3000, "crs_min", 10, 4, 8, plans);
+	rain_plans_close (plans);
+	unlink (path);
+
+	test_unavailable_source ("crs", 6, 2);
+	test_unavailable_source ("crs", 8, 4);
+	test_unavailable_source ("liber8tion", 5, 2);
+
+	test_budgets ("crs", 8, 4);
+	test_budgets ("liber8tion", 6, 2);
+
+	return 0;
+}
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "./librain.h"
+#include "./rain_stream.h"
+#include "./test_utils.h"
+
+struct object_s
+{
+	struct rain_encoding_s enc;
+	uint8_t *buf;
+	uint8_t *blocks[64];
+	int erasures[65];
+
+	uint8_t *out;
+	size_t next[65]; /**< The next offset expected by the sink */
+	size_t largest_read;
+	int fail_read;
+};
+
+static size_t allocated = 0;
+
+static void *
+_malloc (size_t size)
+{
+	allocated += size;
+	return malloc (size);
+}
+
+static struct rain_env_s env_COUNTING = { _malloc, calloc, free };
+
+static int
+_read (void *udata, unsigned int index, size_t offset, uint8_t *buf, size_t len)
+{
+	struct object_s *o = udata;
+	for (int *e = o->erasures; *e >= 0 ;++e)
+		assert ((unsigned int)*e != index);
+	assert (offset + len <= o->enc.block_size);
+	if (o->fail_read && !--o->fail_read)
+		return 0;
+	o->largest_read = MACRO_COND(len > o->largest_read, len, o->largest_read);
+	memcpy (buf, o->blocks[index] + offset, len);
+	return 1;
+}
+
+static int
+_write (void *udata, int index, size_t offset, const uint8_t *buf, size_t len)
+{
+	struct object_s *o = udata;
+	if (index < 0) {
+		assert (offset == o->next[64]);
+		assert (offset + len <= o->enc.data_size);
+		memcpy (o->out + offset, buf, len);
+		o->next[64] += len;
+	} else {
+		assert (offset == o->next[index]);
+		assert (offset + len <= o->enc.block_size);
+		assert (0 == memcmp (o->blocks[index] + offset, buf, len));
+		o->next[index] += len;
+	}
+	return 1;
+}
+
+static void
+_stream (struct object_s *o, int mode, size_t memory)
+{
+	struct rain_stream_s st;
+	memset (&st, 0, sizeof(st));
+	st.encoding = &o->enc;
+	st.erasures = o->erasures;
+	st.mode = mode;
+	st.memory = memory;
+	st.env = &env_COUNTING;
+	st.read = _read;
+	st.write = _write;
+	st.udata = o;
+
+	memset (o->next, 0, sizeof(o->next));
+	memset (o->out, 0, o->enc.data_size + 1);
+	o->largest_read = 0;
+	allocated = 0;
+	int rc = rain_stream_rehydrate (&st);
+	assert (rc != 0);
+
+	// Within the budget, or one strip per buffer
+	const unsigned int k = o->enc.k;
+	size_t floor = (k + o->enc.m) * o->enc.strip_size;
+	assert (allocated <= MACRO_COND(memory > floor, memory, floor));
+	assert (o->largest_read <= MACRO_COND(memory > floor, memory / k, o->enc.strip_size));
+
+	if (mode == RAIN_STREAM_OBJECT) {
+		assert (o->next[64] == o->enc.data_size);
+		assert (0 == memcmp (o->out, o->buf, o->enc.data_size));
+	} else {
+		for (int *e = o->erasures; *e >= 0 ;++e)
+			assert (o->next[*e] == o->enc.block_size);
+	}
+}
+
+static void
+test_stream (size_t length, const char *algo, unsigned int k, unsigned int m,
+		int flags)
+{
+	struct object_s o;
+	memset (&o, 0, sizeof(o));
+	int rc = rain_get_encoding_ext (&o.enc, length, k, m, algo, flags);
+	assert (rc != 0);
+	o.buf = malloc (o.enc.padded_data_size);
+	o.out = malloc (length + 1);
+	randomize (o.buf, length);
+	memset (o.buf + length, 0, o.enc.padded_data_size - length);
+	for (unsigned int i=0; i<k ;++i)
+		o.blocks[i] = o.buf + (i * o.enc.block_size);
+	rc = rain_encode (o.buf, length, &o.enc, NULL, o.blocks + k);
+	assert (rc != 0);
+
+	const unsigned int sum = k + m;
+	for (unsigned int round=0; round<6 ;++round) {
+		unsigned int nb = 0;
+		for (unsigned int i=0; i<sum && nb<m ;++i) {
+			if (random () % sum < m)
+				o.erasures[nb++] = i;
+		}
+		o.erasures[nb] = -1;
+		size_t memory = (round % 3) * (size_t)(random () % (4 * MiB));
+		_stream (&o, RAIN_STREAM_OBJECT, memory);
+		_stream (&o, RAIN_STREAM_BLOCKS, memory);
+	}
+
+	// A failed read aborts
+	o.erasures[0] = 0;
+	o.erasures[1] = -1;
+	o.fail_read = 2;
+	struct rain_stream_s st;
+	memset (&st, 0, sizeof(st));
+	st.encoding = &o.enc;
+	st.erasures = o.erasures;
+	st.read = _read;
+	st.write = _write;
+	st.udata = &o;
+	memset (o.next, 0, sizeof(o.next));
+	assert (!rain_stream_rehydrate (&st) || length == 0);
+	o.fail_read = 0;
+
+	for (unsigned int i=0; i<m ;++i)
+		free (o.blocks[k + i]);
+	free (o.out);
+	free (o.buf);
+}
+
+int
+main(int argc, char **argv)
+{
+	(void) argc, (void) argv;
+
+	for (size_t length = 0; length < 2*MiB; length += 333333) {
+		test_stream (length, "crs", 6, 2, 0);
+		test_stream (length, "liber8tion", 7, 2, LIBRAIN_TAIL_STRIPE);
+		test_stream (length, "crs", 8, 4, LIBRAIN_TAIL_STRIPE);
+		test_stream (length, "crs_min", 10, 4, 0);
+	}
+	test_stream (33*MiB + 5, "crs", 8, 4, 0);
+
+	return 0;
+}